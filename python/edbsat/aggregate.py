@@ -0,0 +1,218 @@
+import json
+import math
+import os
+import threading
+import time
+
+from edbsat.decoder import *
+
+# Mission-level aggregates of decoded pkts, updated in O(1) per pkt: totals
+# since the start, and the same per day (UTC), so that a query over a time
+# window sums at most one rollup per day instead of re-parsing all pkts.
+
+SNAPSHOT_VERSION = 1
+SECS_PER_DAY = 24 * 3600
+MAX_DAYS = 366 # daily rollups kept, oldest dropped first
+
+APP_FIELDS = ["temp"] + ["mag%u" % i for i in range(APPOUT_NUM_AXES_MAG)] + \
+             ["accel%u" % i for i in range(APPOUT_NUM_AXES_ACCEL)]
+
+class Stat:
+    """Count, sum, sum of squares, min and max of a series of values"""
+
+    def __init__(self, fields=None):
+        if fields is None:
+            fields = [0, 0, 0, None, None]
+        self.n, self.sum, self.sumsq, self.min, self.max = fields
+
+    def add(self, v):
+        self.n += 1
+        self.sum += v
+        self.sumsq += v * v
+        self.min = v if self.min is None else min(self.min, v)
+        self.max = v if self.max is None else max(self.max, v)
+
+    # n values known only by their sum: added as n values equal to the mean,
+    # so the spread within them is not counted
+    def add_sum(self, n, total):
+        if n == 0:
+            return
+        m = total / n
+        self.merge(Stat([n, total, n * m * m, m, m]))
+
+    def merge(self, other):
+        self.n += other.n
+        self.sum += other.sum
+        self.sumsq += other.sumsq
+        for v in [other.min, other.max]:
+            if v is not None:
+                self.min = v if self.min is None else min(self.min, v)
+                self.max = v if self.max is None else max(self.max, v)
+
+    def mean(self):
+        return self.sum / self.n if self.n > 0 else None
+
+    def stdev(self):
+        if self.n == 0:
+            return None
+        m = self.mean()
+        return math.sqrt(max(0, self.sumsq / self.n - m * m))
+
+    def to_list(self):
+        return [self.n, self.sum, self.sumsq, self.min, self.max]
+
+
+class Rollup:
+    """Aggregates of the profiles and app output pkts in some time span.
+
+    Per watchpoint: stats of the event count in a profile, and the sum of
+    each energy bin (its share of the sum over bins is the mean energy
+    distribution). Approximate (Morris) counters, and counts sampled at a
+    duty cycle, are added as estimates of the events in the run. A sum of
+    profiles adds each of its runs, with the mean count of the sum.
+    """
+
+    def __init__(self, fields=None):
+        if fields is None:
+            fields = [0, [[None, [0] * PROFILE_BINS] for i in range(PROFILE_NUM_EVENTS)],
+                      0, [None] * len(APP_FIELDS)]
+        self.profiles = fields[0]
+        self.counts = [Stat(c) for c, bins in fields[1]]
+        self.bins = [list(bins) for c, bins in fields[1]]
+        self.app_pkts = fields[2]
+        self.app = [Stat(f) for f in fields[3]]
+
+    def add_profile(self, flags, events, duty):
+        self.profiles += 1
+        for i, (count, bins) in enumerate(profile_event_estimates(flags, events, duty)):
+            self.counts[i].add(count)
+            for j, b in enumerate(bins):
+                self.bins[i][j] += b
+
+    def add_profile_sum(self, runs, bins):
+        self.profiles += runs
+        for i, b in enumerate(bins):
+            self.counts[i].add_sum(runs, sum(b))
+            for j, v in enumerate(b):
+                self.bins[i][j] += v
+
+    def add_app_output(self, windows):
+        self.app_pkts += 1
+        for temp, m, a in windows:
+            for stat, v in zip(self.app, [temp] + m + a):
+                stat.add(v)
+
+    def merge(self, other):
+        self.profiles += other.profiles
+        for i in range(PROFILE_NUM_EVENTS):
+            self.counts[i].merge(other.counts[i])
+            self.bins[i] = [a + b for a, b in zip(self.bins[i], other.bins[i])]
+        self.app_pkts += other.app_pkts
+        for stat, other_stat in zip(self.app, other.app):
+            stat.merge(other_stat)
+
+    # Mean fraction of events in each bin at watchpoint i
+    def bin_fractions(self, i):
+        total = sum(self.bins[i])
+        return [b / total if total > 0 else None for b in self.bins[i]]
+
+    def to_list(self):
+        return [self.profiles, [[c.to_list(), bins] for c, bins in zip(self.counts, self.bins)],
+                self.app_pkts, [s.to_list() for s in self.app]]
+
+
+class Aggregates:
+    """Totals and daily rollups, updated from the decode loop, and written to
+    a snapshot file from a separate thread, hence the lock."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.total = Rollup()
+        self.days = {} # day number (since the epoch, UTC): Rollup
+        self.first = None # time of first pkt
+        self.last = None
+
+    def add(self, pkt_type, payload, t):
+        if pkt_type == PKT_TYPE_ENERGY_PROFILE:
+            kind = parse_pkt_tag(payload)[0]
+            if kind == PKT_KIND_PROFILE_SUM:
+                flags, runs, bins = parse_profile_sum(payload)
+                update = lambda r: r.add_profile_sum(runs, bins)
+            elif kind in [PKT_KIND_PROFILE, PKT_KIND_PROFILE_PROGRESSIVE]:
+                flags, events, edge, duty = parse_profile(payload)
+                update = lambda r: r.add_profile(flags, events, duty)
+            else:
+                return
+        elif pkt_type == PKT_TYPE_APP_OUTPUT:
+            windows = parse_app_output(payload)
+            update = lambda r: r.add_app_output(windows)
+        else:
+            return
+
+        with self.lock:
+            day = int(t // SECS_PER_DAY)
+            if day not in self.days:
+                self.days[day] = Rollup()
+                if len(self.days) > MAX_DAYS:
+                    del self.days[min(self.days)]
+            update(self.days[day])
+            update(self.total)
+            self.first = t if self.first is None else self.first
+            self.last = t
+
+    # Rollup over the last 'days' days up to the last pkt (all, if None)
+    def query(self, days=None):
+        with self.lock:
+            if days is None:
+                r = Rollup(self.total.to_list())
+            else:
+                r = Rollup()
+                last_day = int(self.last // SECS_PER_DAY) if self.last is not None else 0
+                for day, rollup in self.days.items():
+                    if day > last_day - days:
+                        r.merge(rollup)
+            return r
+
+    def to_dict(self):
+        with self.lock:
+            return {"version": SNAPSHOT_VERSION,
+                    "first": self.first, "last": self.last,
+                    "total": self.total.to_list(),
+                    "days": [[day, r.to_list()] for day, r in sorted(self.days.items())]}
+
+    @staticmethod
+    def from_dict(d):
+        if d.get("version") != SNAPSHOT_VERSION:
+            raise Exception("Unsupported aggregates snapshot version: %s" % d.get("version"))
+        agg = Aggregates()
+        agg.first, agg.last = d["first"], d["last"]
+        agg.total = Rollup(d["total"])
+        agg.days = dict((day, Rollup(r)) for day, r in d["days"])
+        return agg
+
+def load_aggregates(path):
+    with open(path) as f:
+        return Aggregates.from_dict(json.load(f))
+
+def save_aggregates(agg, path):
+    # Write to a temp file and rename, so that readers never see a partial file
+    tmp_path = path + ".tmp"
+    with open(tmp_path, "w") as f:
+        json.dump(agg.to_dict(), f, separators=(",", ":"))
+    os.rename(tmp_path, path)
+
+
+class AggregatesSaver:
+    """Periodically saves a snapshot of the aggregates to a file"""
+
+    def __init__(self, agg, path, interval=60):
+        self.agg = agg
+        self.path = path
+        self.interval = interval
+        self.thread = threading.Thread(target=self.save_periodically, daemon=True)
+        self.thread.start()
+
+    def save_periodically(self):
+        while True:
+            time.sleep(self.interval)
+            save_aggregates(self.agg, self.path)
@@ -0,0 +1,88 @@
+#!/usr/bin/python
+
+import argparse
+import contextlib
+import io
+import random
+import time
+from collections import Counter
+
+from edbsat.decoder import *
+from edbsat.encoder import *
+from edbsat.channel import *
+
+BEACON_PROBABILITY_LOG2 = 2 # see edb-sat/bld/Makefile
+
+SCENARIOS = {
+    # name: channel parameters, besides ber
+    "iid": dict(),
+    "burst": dict(burst_len=8),
+    "drop": dict(drop=0.01),
+    "beacons": dict(beacons=0.01),
+}
+
+parser = argparse.ArgumentParser(
+    description="Benchmark the delivery of the packet format over a simulated " + \
+                "radio channel, across bit error rates")
+parser.add_argument('--pkts', type=int, default=2000,
+    help="Packets to transmit in each run")
+parser.add_argument('--ber', type=float, nargs='+',
+    default=[0, 1e-4, 3e-4, 1e-3, 3e-3, 1e-2, 3e-2],
+    help="Bit error rates to sweep")
+parser.add_argument('--scenario', nargs='+', choices=SCENARIOS.keys(),
+    default=list(SCENARIOS.keys()),
+    help="Channel models to sweep")
+parser.add_argument('--seed', type=int, default=1,
+    help="Seed for the workload and channel")
+args = parser.parse_args()
+
+# The firmware sends one chunk per transmission, in idx order, and a beacon
+# instead with a fixed probability
+def workload(n, rng):
+    pkts = []
+    data = []
+    for i in range(n):
+        pkt_type = rng.choice([PKT_TYPE_ENERGY_PROFILE, PKT_TYPE_APP_OUTPUT])
+        size = rng.choice(PKT_SIZES_BY_TYPE[pkt_type])
+        payload = [rng.randrange(256) for j in range(size)]
+        pkts.append((pkt_type, tuple(payload)))
+        for chunk in encode_pkt(pkt_type, payload):
+            while rng.randrange(2**BEACON_PROBABILITY_LOG2) == 0:
+                data.append(BEACON)
+            data += chunk
+    return pkts, data
+
+print("%-8s %8s %6s %9s %6s %8s %6s %8s %9s" % ("scenario", "ber", "sent",
+      "delivered", "frac", "goodput", "false", "false/1k", "kB/s"))
+
+for scenario in args.scenario:
+    for ber in args.ber:
+        rng = random.Random(args.seed)
+        pkts, tx = workload(args.pkts, rng)
+        channel = Channel(ber=ber, seed=args.seed, **SCENARIOS[scenario])
+        rx = channel.transmit(tx)
+
+        start = time.perf_counter()
+        with contextlib.redirect_stdout(io.StringIO()), contextlib.redirect_stderr(io.StringIO()):
+            decoded = decode_all(rx)
+        elapsed = time.perf_counter() - start
+
+        unmatched = Counter(pkts)
+        delivered = 0
+        payload_bytes = 0
+        false_accepts = 0
+        for pkt_type, payload in decoded:
+            if pkt_type == PKT_TYPE_BEACON:
+                continue
+            pkt = (pkt_type, tuple(payload))
+            if unmatched[pkt] > 0:
+                unmatched[pkt] -= 1
+                delivered += 1
+                payload_bytes += len(payload)
+            else:
+                false_accepts += 1
+
+        print("%-8s %8.0e %6u %9u %6.3f %8.4f %6u %8.2f %9.1f" % (scenario, ber,
+              len(pkts), delivered, delivered / len(pkts), payload_bytes / len(tx),
+              false_accepts, 1000 * false_accepts / len(pkts),
+              len(rx) / elapsed / 1000))
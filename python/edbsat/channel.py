@@ -0,0 +1,64 @@
+import random
+
+from edbsat.decoder import BEACON
+
+class Channel:
+    """Models of the radio link, applied to each transmission.
+
+    ber: probability of a bit error, in i.i.d. errors or, if burst_len > 0,
+         on average in a two-state (Gilbert-Elliott) model, where bits in
+         the bad state have errors with probability burst_ber and bursts
+         last burst_len bits on average
+    drop: probability of losing a byte
+    beacons: probability of a spurious BEACON byte at each byte boundary
+    """
+
+    def __init__(self, ber=0, burst_len=0, burst_ber=0.5, drop=0, beacons=0, seed=1):
+        self.rng = random.Random(seed)
+        self.ber = ber
+        self.burst_len = burst_len
+        self.burst_ber = burst_ber
+        self.drop = drop
+        self.beacons = beacons
+
+        self.bad = False
+        if burst_len > 0:
+            if ber > burst_ber:
+                raise Exception("Average BER must be below the BER in bursts")
+            self.p_bad_to_good = 1.0 / burst_len
+            # fraction of bits in bad state is ber/burst_ber
+            frac_bad = ber / burst_ber
+            self.p_good_to_bad = self.p_bad_to_good * frac_bad / (1 - frac_bad)
+
+        self.bit_errors = 0
+        self.bytes_dropped = 0
+        self.beacons_inserted = 0
+
+    def bit_error(self):
+        if self.burst_len == 0:
+            return self.rng.random() < self.ber
+        if self.bad:
+            if self.rng.random() < self.p_bad_to_good:
+                self.bad = False
+        else:
+            if self.rng.random() < self.p_good_to_bad:
+                self.bad = True
+        return self.bad and self.rng.random() < self.burst_ber
+
+    def transmit(self, data):
+        rx = []
+        for b in data:
+            if self.rng.random() < self.beacons:
+                rx.append(BEACON)
+                self.beacons_inserted += 1
+
+            for j in range(8):
+                if self.bit_error():
+                    b ^= 1 << j
+                    self.bit_errors += 1
+
+            if self.rng.random() < self.drop:
+                self.bytes_dropped += 1
+                continue
+            rx.append(b)
+        return rx
@@ -1,6 +1,7 @@
 #!/usr/bin/python
 
 import argparse
+import os
 import sys
 import select
 import time
@@ -13,12 +14,29 @@ parser.add_argument('data_in', nargs='?',
     help="Input file with binary data")
 parser.add_argument('--hex', action='store_true',
     help="Input file is an ASCII text file with hex numbers separated by whitespace")
+parser.add_argument('--ring',
+    help="Read from the shared memory ring fed by the receiver (edbsat-ring-feed), " + \
+         "instead of the input file")
 parser.add_argument("--display", "-d",
                     help="serial port of ODROIDshow LCD screen (e.g., /dev/ttyUSB0)")
+parser.add_argument("--display-fps", type=float, default=2,
+                    help="max rate (frames/sec) at which LCD screen is updated")
 parser.add_argument('--output', '-o',
     help="Output file with parsed packets (text)")
 parser.add_argument('--output-bytes',
     help="Output file where to save received bytes (binary)")
+parser.add_argument('--reassembly-window', type=float, default=3600,
+    help="Time (sec) to keep a partially received pkt without new chunks")
+parser.add_argument('--metrics',
+    help="Export decoder metrics (Prometheus text format) to this file, " + \
+         "or serve them on a Unix socket if given as 'unix:<path>'")
+parser.add_argument('--metrics-interval', type=float, default=10,
+    help="Interval (sec) between exports of metrics to file")
+parser.add_argument('--aggregates',
+    help="Keep mission-level aggregates of decoded packets in this snapshot file " + \
+         "(resumed if it exists, see edbsat-query)")
+parser.add_argument('--aggregates-interval', type=float, default=60,
+    help="Interval (sec) between saves of the aggregates snapshot")
 args = parser.parse_args()
 
 if args.display:
@@ -26,6 +44,8 @@ if args.display:
 
 PKT_TYPE_TO_STRING = {
     PKT_TYPE_BEACON: "B",
+    PKT_TYPE_BEACON_STATUS: "S",
+    PKT_TYPE_PROFILE_ESTIMATE: "p",
     PKT_TYPE_ENERGY_PROFILE: "P",
     PKT_TYPE_APP_OUTPUT: "A",
 }
@@ -73,7 +93,10 @@ def parse_hex(ch):
         s = None
         return None
 
-if args.data_in:
+if args.ring:
+    from edbsat.ring import RingReader
+    fin = None
+elif args.data_in:
     if args.hex:
         fin_mode = ""
     else:
@@ -98,104 +121,213 @@ def format_pkt(payload_type, payload):
     if payload_type == PKT_TYPE_BEACON:
         s = "B"
 
+    elif payload_type == PKT_TYPE_BEACON_STATUS:
+        unsent, vbank, flash, stop = parse_beacon_status(payload)
+        s = "S: unsent %u | Vbank >%.2fV | flash >%u%% | last stop %s" % \
+                (unsent, vbank, flash * 100, stop)
+
+    elif payload_type == PKT_TYPE_ENERGY_PROFILE and \
+            parse_pkt_tag(payload)[0] == PKT_KIND_ENERGY_BUDGET:
+        kind, flags, payload = parse_pkt_tag(payload)
+        vbank, phases = parse_budget(payload, flags)
+        s = "E: %.2fV " % vbank
+        for name, v, t in phases:
+            s += "| %s %.3fs -> %.2fV (%+.0fmV) " % (name, t, v, (v - vbank) * 1000)
+            vbank = v
+
+    elif payload_type == PKT_TYPE_ENERGY_PROFILE and \
+            parse_pkt_tag(payload)[0] == PKT_KIND_BOOT_TIMING:
+        kind, flags, payload = parse_pkt_tag(payload)
+        s = "L: %s " % ("fast" if flags & PKT_FLAG_BOOT_TIMING_FAST else "full")
+        for name, t in parse_boot_timing(payload):
+            s += "| %s %.1fms " % (name, t * 1000)
+
+    elif payload_type == PKT_TYPE_ENERGY_PROFILE and \
+            parse_pkt_tag(payload)[0] == PKT_KIND_TRANSITIONS:
+        kind, flags, payload = parse_pkt_tag(payload)
+        first, m = parse_transitions(payload, flags)
+        s = "T: first %s " % ("-" if first is None else first)
+        approx = "~" if flags & PKT_FLAG_TRANSITIONS_APPROX else ""
+        for i, j, c, p in transition_graph(m):
+            sat = "+" if c == TRANSITION_COUNT_MAX and not approx else ""
+            s += "| %u->%u %s%u%s (%.0f%%) " % (i, j, approx, c, sat, p * 100)
+
+    elif payload_type == PKT_TYPE_ENERGY_PROFILE and \
+            parse_pkt_tag(payload)[0] == PKT_KIND_PROFILE_SUM:
+        flags, runs, bins = parse_profile_sum(payload)
+        s = "R: %u runs " % runs
+        for b in bins:
+            sat = "+" if PROFILE_SUM_BIN_MAX in b else ""
+            s += "| %u%s [%s] (%.1f/run) " % (sum(b), sat, ":".join(map(str, b)),
+                    sum(b) / runs if runs > 0 else 0)
+
+        stop = flags >> PKT_FLAG_PROFILE_STOP_SHIFT
+        if stop != 0:
+            s += "last stop %s " % PROFILE_STOP_NAMES[stop]
+
+        if flags & PKT_FLAG_PROFILE_SUM_OVERFLOW:
+            s += "[overflow]"
+        if flags & PKT_FLAG_PROFILE_PARTIAL:
+            s += "[partial]"
+
+    elif payload_type == PKT_TYPE_PROFILE_ESTIMATE:
+        kind, flags, payload = parse_pkt_tag(payload)
+        approx = flags & PKT_FLAG_PROFILE_APPROX
+        def fmt_range(lo, hi):
+            if approx:
+                lo, hi = morris_estimate(lo)[0], morris_estimate(hi)[0]
+            return "%s%u" % ("~" if approx else "", lo) if lo == hi else "%u-%u" % (lo, hi)
+        s = "p: %u/%u bytes " % (len(payload), PROFILE_SIZE)
+        for count, bin0, bin1 in parse_profile_planes(payload):
+            s += "| %s [%s:%s] " % (fmt_range(*count), fmt_range(*bin0), fmt_range(*bin1))
+        s += "[unverified]"
+
     elif payload_type == PKT_TYPE_ENERGY_PROFILE:
+        flags, events, edge, duty = parse_profile(payload)
+        scale = duty_scale(duty)
         s = "P: "
-        field_dec = FieldDecoder(payload)
-        
-        p = 0
-        for i in range(PROFILE_NUM_EVENTS):
-            bins = []
-            for j in range(PROFILE_BINS):
-                c = field_dec.decode_field(PROFILE_FIELD_WIDTH_BIN)
-                bins.append(c)
-            count = field_dec.decode_field(PROFILE_FIELD_WIDTH_COUNT)
-
-            s += "| %u [%s] " % (count, ":".join(map(str, bins)))
 
-    elif payload_type == PKT_TYPE_APP_OUTPUT:
-        s = "A: "
-        field_dec = FieldDecoder(payload)
+        for (count, bins), (n, n_bins) in zip(events, profile_event_estimates(flags, events, duty)):
+            if flags & PKT_FLAG_PROFILE_APPROX:
+                lo, hi = morris_estimate(count)[1:]
+                s += "| ~%u (%u-%u) [%s] " % (round(n), round(lo * scale), round(hi * scale),
+                        ":".join("~%u" % round(b) for b in n_bins))
+            elif duty is not None: # estimate, then the count of sampled events
+                s += "| ~%u (%u) [%s] " % (round(n), count,
+                        ":".join("~%u" % round(b) for b in n_bins))
+            else:
+                s += "| %u [%s] " % (count, ":".join(map(str, bins)))
 
-        for i in range(APPOUT_NUM_WINDOWS):
-            temp = twocomp(field_dec.decode_field(APPOUT_FIELD_WIDTH_TEMP), APPOUT_FIELD_WIDTH_TEMP)
+        if edge is not None:
+            s += "edge %.2fV " % profile_edge_to_volts(edge)
 
-            m = []
-            for i in range(APPOUT_NUM_AXES_MAG):
-                m.append(twocomp(field_dec.decode_field(APPOUT_FIELD_WIDTH_MAG), APPOUT_FIELD_WIDTH_MAG))
-            a = []
-            for i in range(APPOUT_NUM_AXES_ACCEL):
-                a.append(twocomp(field_dec.decode_field(APPOUT_FIELD_WIDTH_ACCEL), APPOUT_FIELD_WIDTH_ACCEL))
+        if duty is not None:
+            s += "duty %.1f%% " % (100 * duty / PROFILE_DUTY_ONE)
+
+        if flags & PKT_FLAG_PROFILE_PARTIAL:
+            s += "[partial]"
+
+    elif payload_type == PKT_TYPE_APP_OUTPUT:
+        s = "A: "
 
+        for temp, m, a in parse_app_output(payload):
             s += "[temp %u mag (%s) accel (%s)] " % \
                     (temp, ",".join(map(str, m)), ",".join(map(str,a)))
     return s
 
 
-inbuf = []
-
 if args.display:
-    display = Display(port=args.display)
+    display = Display(port=args.display, fps=args.display_fps)
 
-decoder = Decoder()
+if args.metrics:
+    from edbsat.metrics import DecoderMetrics, MetricsExporter
+    metrics = DecoderMetrics()
+    metrics_exporter = MetricsExporter(metrics, args.metrics, args.metrics_interval)
+else:
+    metrics = None
+
+if args.aggregates:
+    import atexit
+    import signal
+    from edbsat.aggregate import Aggregates, AggregatesSaver, load_aggregates, save_aggregates
+    if os.path.exists(args.aggregates):
+        aggregates = load_aggregates(args.aggregates)
+    else:
+        aggregates = Aggregates()
+    aggregates_saver = AggregatesSaver(aggregates, args.aggregates, args.aggregates_interval)
+    # Also save on exit, including when the service is stopped
+    atexit.register(save_aggregates, aggregates, args.aggregates)
+    signal.signal(signal.SIGTERM, lambda signum, frame: sys.exit(0))
+else:
+    aggregates = None
+
+# From the ring, partial pkts expire by the time the bytes were received,
+# not by when they were decoded
+rx_time = None
+clock = (lambda: rx_time) if args.ring else time.time
+decoder = Decoder(metrics=metrics, reassembly_window=args.reassembly_window,
+                  clock=clock, estimates=True)
+
+def output_pkt(pkt):
+    payload_type, payload = pkt
+
+    pkt_s = "%s" % PKT_TYPE_TO_STRING[payload_type]
+    if len(payload) > 0:
+        pkt_s += ": " + " ".join(["%02x" % b for b in payload])
+    print(pkt_s)
+
+    pkt_str = format_pkt(payload_type, payload)
+    fout.write(pkt_str + "\n")
+    fout.flush()
+
+    if aggregates is not None:
+        aggregates.add(payload_type, payload, clock())
+    if args.display:
+        display.show_pkt(pkt_str)
+
+def decode_bytes(data):
+    if output_bytes is not None:
+        output_bytes.write(bytes(data))
+        output_bytes.flush()
+
+    if metrics is not None:
+        metrics.count_byte(len(data))
+
+    inbuf = list(data[::-1])
+    while len(inbuf) > 0:
+        b = inbuf.pop()
+        pkt = decoder.decode(b)
+
+        put_back = False
+        if pkt is not None:
+            if pkt == b: # put back
+                inbuf.append(b)
+                put_back = True
+                if metrics is not None:
+                    metrics.count_put_back()
+            else:
+                output_pkt(pkt)
+                for pkt in decoder.take_completed():
+                    output_pkt(pkt)
+
+        if args.display and not put_back:
+            display.show_bytes([b])
+
+# Takes all frames in the ring at each wakeup: no text and no syscall per byte
+if args.ring:
+    ring = RingReader(args.ring)
+    while True:
+        for rx_time, data in ring.wait():
+            decode_bytes(data)
+        if metrics is not None:
+            metrics.set_ring_dropped(ring.dropped())
 
 while True:
 
-    if len(inbuf) == 0:
-
-        readable, writeable, exceptional = select.select([fin], [], [fin])
-        if fin in exceptional:
-            raise Exception("select encountered error")
+    readable, writeable, exceptional = select.select([fin], [], [fin])
+    if fin in exceptional:
+        raise Exception("select encountered error")
 
-        if fin in readable:
-            bs = fin.read(1)
-            if len(bs) == 0:
-                no_data = True
-                if args.hex:
-                    new_b = parse_hex(None) # flush current token
-                    if new_b is None:
-                        no_data = True
-                else: 
+    if fin in readable:
+        bs = fin.read(1)
+        if len(bs) == 0:
+            no_data = True
+            if args.hex:
+                new_b = parse_hex(None) # flush current token
+                if new_b is None:
                     no_data = True
+            else: 
+                no_data = True
 
-                if no_data:
-                    time.sleep(1) # on fifo pipes, select returns (?)
-                    continue # eof
-
-        if args.hex:
-            new_b = parse_hex(bs)
-            if new_b is None:
-                continue # no token, keep going
-        else:
-            new_b = bs[0]
-
-        if output_bytes is not None:
-            output_bytes.write(bytes([new_b]))
-            output_bytes.flush()
-
-        inbuf = [int(new_b)] + inbuf
-
-    b = inbuf.pop()
-
-    pkt = decoder.decode(b)
-
-    put_back = False
-    if pkt is not None:
-        if pkt == b: # put back
-            inbuf.append(b)
-            put_back = True
-        else:
-            payload_type, payload = pkt
-
-            pkt_s = "%s" % PKT_TYPE_TO_STRING[payload_type]
-            if len(payload) > 0:
-                pkt_s += ": " + " ".join(["%02x" % b for b in payload])
-            print(pkt_s)
+            if no_data:
+                time.sleep(1) # on fifo pipes, select returns (?)
+                continue # eof
 
-            pkt_str = format_pkt(payload_type, payload)
-            fout.write(pkt_str + "\n")
-            fout.flush()
-            if args.display:
-                display.show_pkt(pkt_str)
+    if args.hex:
+        new_b = parse_hex(bs)
+        if new_b is None:
+            continue # no token, keep going
+    else:
+        new_b = bs[0]
 
-    if args.display and not put_back:
-        display.show_bytes([b])
+    decode_bytes([int(new_b)])
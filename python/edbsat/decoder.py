@@ -1,6 +1,11 @@
+import math
 import sys
+import time
 from pycrc.crc_algorithms import Crc
 
+from edbsat.metrics import ERR_INVALID_TYPE, ERR_CHUNK_CHKSUM, ERR_PAYLOAD_SIZE
+from edbsat.reassembly import Reassembler
+
 BEACON = 0xED
 
 # see rad_pkt_t in edb-sat/src/payload.h
@@ -11,6 +16,16 @@ PKT_IDX_MASK    = 0x0F
 PKT_TYPE_ENERGY_PROFILE = 0
 PKT_TYPE_APP_OUTPUT     = 1
 PKT_TYPE_BEACON         = 3 # introduce fake type, for legibility
+PKT_TYPE_BEACON_STATUS  = 4 # fake type: beacon followed by status
+PKT_TYPE_PROFILE_ESTIMATE = 5 # fake type: first chunks of a progressive profile
+
+PKT_TYPE_NAME = {
+    PKT_TYPE_BEACON: "beacon",
+    PKT_TYPE_BEACON_STATUS: "beacon_status",
+    PKT_TYPE_PROFILE_ESTIMATE: "profile_estimate",
+    PKT_TYPE_ENERGY_PROFILE: "energy_profile",
+    PKT_TYPE_APP_OUTPUT: "app_output",
+}
 
 MB_HDR_FIELD_WIDTH_CHKSUM = 4
 MB_HDR_FIELD_WIDTH_SIZE = 4
@@ -22,6 +37,232 @@ PROFILE_BITS_PER_BIN = 4
 
 PROFILE_FIELD_WIDTH_BIN = 5
 PROFILE_FIELD_WIDTH_COUNT = 6
+PROFILE_SIZE = PROFILE_NUM_EVENTS * 2
+
+# Energy profile payloads other than a plain profile start with a tag byte
+# (see pkt_tag_t in edb-sat/src/payload.h)
+PKT_TAG_FIELD_WIDTH_KIND = 3
+PKT_TAG_FIELD_WIDTH_FLAGS = 5
+
+PKT_KIND_PROFILE = 0
+PKT_KIND_ENERGY_BUDGET = 1
+PKT_KIND_TRANSITIONS = 2
+PKT_KIND_BOOT_TIMING = 3
+PKT_KIND_PROFILE_PROGRESSIVE = 4 # flags as for PKT_KIND_PROFILE
+PKT_KIND_PROFILE_SUM = 5 # PARTIAL and STOP flags as for PKT_KIND_PROFILE
+
+PKT_FLAG_PROFILE_PARTIAL = 0x01
+PKT_FLAG_PROFILE_EDGES = 0x02
+PKT_FLAG_PROFILE_APPROX = 0x04
+
+PKT_FLAG_PROFILE_STOP_SHIFT = 3 # in sums; profiles keep it in the pkt descriptor
+PROFILE_STOP_NAMES = ["unknown", "vcap", "overflow", "timeout"] # see profile_stop_t
+
+PKT_FLAG_PROFILE_SUM_OVERFLOW = 0x02
+
+PKT_FLAG_BUDGET_SENT = 0x01
+
+PKT_FLAG_TRANSITIONS_APPROX = 0x01
+PKT_FLAG_TRANSITIONS_FIRST = 0x02
+PKT_FLAG_TRANSITIONS_FIRST_SHIFT = 2
+
+PKT_FLAG_BOOT_TIMING_FAST = 0x01
+
+# Status bytes after the beacon byte (see beacon_status_t in edb-sat/src/payload.h)
+BEACON_STATUS_MARKER = [0x19, 0x10] # in each byte
+BEACON_STATUS_CHKSUM_MASK = 0x0C # in second byte
+BEACON_VBANK_MIN = 1.9 # V, see edb-sat/bld/Makefile
+BEACON_VBANK_STEP = 0.1 # V
+
+# Bin edge byte is the top bits of the ADC code of Vcap (see ehist.h)
+PROFILE_FIELD_WIDTH_EDGE = 8
+ADC_BITS = 12
+ADC_VREF = 1.5 # V, see VDD_AP_REF in edb-sat/bld/Makefile
+ADC_VCAP_DIV = 5.49 / (4.22 + 5.49) # see VDD_AP_DIV in edb-sat/bld/Makefile
+
+# Estimated number of events from a Morris counter value c, incremented with
+# probability 2^-c, with bounds from a normal approximation of its variance
+# n(n-1)/2 (z=1.96 for 95%). At least c events happened.
+def morris_estimate(c, z=1.96):
+    n = 2**c - 1
+    sd = math.sqrt(n * (n - 1) / 2)
+    return n, max(c, int(n - z * sd)), int(math.ceil(n + z * sd))
+
+# With duty-cycled sampling, the byte after the profile in a pkt without the
+# EDGES flag is the fraction of the run with watchpoints enabled, in 1/256
+# (see profile_duty_cycle in edb-sat/src/profile.h)
+PROFILE_FIELD_WIDTH_DUTY = 8
+PROFILE_DUTY_ONE = 256
+
+# Factor from events counted to events in the run, for the duty cycle byte
+# (None: not sampled). No window opened in a run with a duty cycle of 0, so
+# its counters are all 0.
+def duty_scale(duty):
+    return PROFILE_DUTY_ONE / duty if duty else 1
+
+# Estimated events in the run, as (count, bins) per event, from the counters
+# of parse_profile: Morris counters are expanded, and counts sampled at a
+# duty cycle are scaled up by it
+def profile_event_estimates(flags, events, duty):
+    scale = duty_scale(duty)
+    estimates = []
+    for count, bins in events:
+        if flags & PKT_FLAG_PROFILE_APPROX:
+            count = morris_estimate(count)[0]
+            bins = [morris_estimate(b)[0] for b in bins]
+        estimates.append((count * scale, [b * scale for b in bins]))
+    return estimates
+
+# Sum of the profiles of several runs (see profile_sum_t in
+# edb-sat/src/accum.h): run count, then the sum of each bin per event. The
+# count of an event is the sum of its bins.
+PROFILE_SUM_FIELD_WIDTH_RUNS = 8
+PROFILE_SUM_FIELD_WIDTH_BIN = 8
+PROFILE_SUM_BIN_MAX = 2**PROFILE_SUM_FIELD_WIDTH_BIN - 1 # saturates
+PROFILE_SUM_SIZE = (PROFILE_SUM_FIELD_WIDTH_RUNS + \
+        PROFILE_NUM_EVENTS * PROFILE_BINS * PROFILE_SUM_FIELD_WIDTH_BIN) // 8
+
+# Returns the flags, the number of runs, and the bin sums per event
+def parse_profile_sum(payload):
+    kind, flags, payload = parse_pkt_tag(payload)
+    fd = FieldDecoder(list(payload))
+    runs = fd.decode_field(PROFILE_SUM_FIELD_WIDTH_RUNS)
+    bins = [[fd.decode_field(PROFILE_SUM_FIELD_WIDTH_BIN) for j in range(PROFILE_BINS)]
+                for i in range(PROFILE_NUM_EVENTS)]
+    return flags, runs, bins
+
+def profile_edge_to_volts(edge):
+    code = edge << (ADC_BITS - PROFILE_FIELD_WIDTH_EDGE)
+    return code * ADC_VREF / 2**ADC_BITS / ADC_VCAP_DIV
+
+# Bits of a progressive profile, most significant first (see payload.h):
+# (event, field, bit), where field 0 is the count, and 1 and 2 are the bins
+PROFILE_PLANE_ORDER = [(i, f, k) for k in reversed(range(PROFILE_FIELD_WIDTH_COUNT))
+                            for i in range(PROFILE_NUM_EVENTS)
+                            for f in range(1 + PROFILE_BINS)
+                            if f == 0 or k < PROFILE_FIELD_WIDTH_BIN]
+
+# Returns the range (lo, hi) of each counter, as [count, bin0, bin1] per
+# event, from the bytes received so far of a progressive profile
+def parse_profile_planes(payload):
+    widths = [PROFILE_FIELD_WIDTH_COUNT] + [PROFILE_FIELD_WIDTH_BIN] * PROFILE_BINS
+    known = [[0] * len(widths) for i in range(PROFILE_NUM_EVENTS)]
+    unknown = [list(widths) for i in range(PROFILE_NUM_EVENTS)] # low bits not received
+    nbits = min(len(payload), PROFILE_SIZE) * 8
+    for pos, (i, f, k) in enumerate(PROFILE_PLANE_ORDER[:nbits]):
+        known[i][f] |= ((payload[pos // 8] >> (pos % 8)) & 0x1) << k
+        unknown[i][f] = k
+    return [[(v, v + 2**u - 1) for v, u in zip(vs, us)] for vs, us in zip(known, unknown)]
+
+# Layout of a plain profile (see event_t in edb-sat/src/profile.h) from a
+# complete progressive one
+def profile_planes_to_plain(payload):
+    plain = []
+    for ranges in parse_profile_planes(payload):
+        (count, _), (bin0, _), (bin1, _) = ranges
+        v = bin0 | bin1 << PROFILE_FIELD_WIDTH_BIN | count << (2 * PROFILE_FIELD_WIDTH_BIN)
+        plain += [v & 0xFF, v >> 8]
+    return plain
+
+# Counts of consecutive watchpoint pairs (see profile_transitions_t in
+# edb-sat/src/profile.h): 4-bit saturating counters, low nibble first
+TRANSITION_FIELD_WIDTH_COUNT = 4
+TRANSITION_COUNT_MAX = 2**TRANSITION_FIELD_WIDTH_COUNT - 1
+TRANSITIONS_SIZE = PROFILE_NUM_EVENTS**2 * TRANSITION_FIELD_WIDTH_COUNT // 8
+
+# Returns the watchpoint hit first in the run (None if no watchpoint was hit),
+# and the matrix of counts (estimated, if approximate): m[i][j] for i -> j
+def parse_transitions(payload, flags):
+    fd = FieldDecoder(list(payload))
+    m = [[fd.decode_field(TRANSITION_FIELD_WIDTH_COUNT) for j in range(PROFILE_NUM_EVENTS)]
+            for i in range(PROFILE_NUM_EVENTS)]
+    if flags & PKT_FLAG_TRANSITIONS_APPROX:
+        m = [[morris_estimate(c)[0] for c in row] for row in m]
+    first = None
+    if flags & PKT_FLAG_TRANSITIONS_FIRST:
+        first = flags >> PKT_FLAG_TRANSITIONS_FIRST_SHIFT
+    return first, m
+
+# Edges (i, j, count, probability of j after i) of the transition graph,
+# with probabilities normalized over the transitions out of each watchpoint
+def transition_graph(m):
+    edges = []
+    for i, row in enumerate(m):
+        total = sum(row)
+        for j, c in enumerate(row):
+            if c > 0:
+                edges.append((i, j, c, c / total))
+    return edges
+
+# Energy budget of a boot, see edb-sat/src/budget.h
+BUDGET_PHASES = ["boot", "transmit", "profile", "save"]
+BUDGET_SIZE = 1 + len(BUDGET_PHASES) * 2 # Vbank at start, (Vbank, duration) per phase
+BUDGET_TIMER_FREQ = 512 # Hz
+VDD_EDB = 2.4 # V, ADC reference for Vbank, see edb-sat/bld/Makefile
+VBANK_DIV = 750 / (100 + 750) # see VBANK_DIV in edb-sat/bld/Makefile
+
+def budget_duration_to_ticks(d):
+    exp, mant = d >> 4, d & 0xF
+    return mant if exp == 0 else (16 + mant) << (exp - 1)
+
+def budget_vbank_to_volts(b):
+    code = (b ^ 0x80) << (ADC_BITS - 8)
+    return code * VDD_EDB / 2**ADC_BITS / VBANK_DIV
+
+# Returns Vbank at start, and a list of (phase, Vbank at end, seconds),
+# for phases that happened. The transmit phase is named 'lookup' if nothing
+# was sent.
+def parse_budget(payload, flags):
+    vbank = budget_vbank_to_volts(payload[0])
+    phases = []
+    for i, name in enumerate(BUDGET_PHASES):
+        v, d = payload[1 + i * 2 : 1 + (i + 1) * 2]
+        ticks = budget_duration_to_ticks(d)
+        if name == "transmit" and not flags & PKT_FLAG_BUDGET_SENT:
+            name = "lookup"
+        if ticks > 0:
+            phases.append((name, budget_vbank_to_volts(v), ticks / BUDGET_TIMER_FREQ))
+    return vbank, phases
+
+# Durations of the phases of a boot until the task is chosen, see
+# edb-sat/src/boottime.h: the longest one (about 8 s) is a lower bound, as
+# the timer saturates
+BOOT_PHASES = ["supply", "clock", "console", "seed", "init"]
+BOOT_TIMING_SIZE = len(BOOT_PHASES) # duration per phase
+BOOT_TIMER_FREQ = 8192 # Hz
+
+# Returns a list of (phase, seconds), for phases that happened
+def parse_boot_timing(payload):
+    phases = []
+    for name, d in zip(BOOT_PHASES, payload):
+        ticks = budget_duration_to_ticks(d)
+        if ticks > 0:
+            phases.append((name, ticks / BOOT_TIMER_FREQ))
+    return phases
+
+# Returns pkts not yet sent, Vbank (V, lower bound), used fraction of the
+# pkt store (lower bound), and why the last profiling run in flash stopped
+def parse_beacon_status(payload):
+    fd = FieldDecoder(list(payload))
+    fd.decode_field(1) # marker
+    stop = PROFILE_STOP_NAMES[fd.decode_field(2)]
+    fd.decode_field(2) # marker
+    unsent = fd.decode_field(3)
+    flash = fd.decode_field(2) / 4
+    fd.decode_field(2) # chksum
+    fd.decode_field(1) # marker
+    vbank = BEACON_VBANK_MIN + fd.decode_field(3) * BEACON_VBANK_STEP
+    return unsent, vbank, flash, stop
+
+def is_beacon_status(b, i):
+    return b & BEACON_STATUS_MARKER[i] == BEACON_STATUS_MARKER[i]
+
+def verify_beacon_status(s1, s2):
+    if not is_beacon_status(s2, 1):
+        return False
+    chksum = crc([s1, s2 & ~BEACON_STATUS_CHKSUM_MASK]) & \
+                (BEACON_STATUS_CHKSUM_MASK >> shift(BEACON_STATUS_CHKSUM_MASK))
+    return chksum == extract_field(s2, BEACON_STATUS_CHKSUM_MASK)
 
 APPOUT_NUM_WINDOWS = 2
 APPOUT_NUM_AXES_MAG = 3
@@ -31,9 +272,11 @@ APPOUT_FIELD_WIDTH_TEMP = 8
 APPOUT_FIELD_WIDTH_MAG = 4
 APPOUT_FIELD_WIDTH_ACCEL = 4
 
-PKT_SIZE_BY_TYPE = {
-    PKT_TYPE_ENERGY_PROFILE: PROFILE_NUM_EVENTS * 2,
-    PKT_TYPE_APP_OUTPUT:     8,
+PKT_SIZES_BY_TYPE = {
+    PKT_TYPE_ENERGY_PROFILE: [PROFILE_SIZE, 1 + PROFILE_SIZE, 1 + PROFILE_SIZE + 1,
+                              1 + BUDGET_SIZE, 1 + TRANSITIONS_SIZE, 1 + BOOT_TIMING_SIZE,
+                              1 + PROFILE_SUM_SIZE],
+    PKT_TYPE_APP_OUTPUT:     [8],
 }
 
 crc_alg = Crc(width=16,
@@ -45,12 +288,9 @@ crc_alg = Crc(width=16,
 
 STATE_NONE = 0
 STATE_HDR  = 1
+STATE_BEACON = 2        # after beacon byte: status may follow
+STATE_BEACON_STATUS = 3 # after first status byte
 
-PAYLOAD_STATE_NONE = 0
-PAYLOAD_STATE_HDR = 1
-PAYLOAD_STATE_HDR_RETRY = 2
-PAYLOAD_STATE_DATA = 3
-PAYLOAD_STATE_DATA_RETRY = 4
 
 def print_err(*args, **kwargs):
     print(*args, file=sys.stderr, **kwargs)
@@ -76,6 +316,9 @@ def crc(b):
     #print("CHK: %02x" % crc_alg.bit_by_bit_fast(b"123456789"))
     return crc_alg.bit_by_bit_fast(bytearray(b))
 
+def verify_payload(payload, chksum):
+    return crc(payload) & MB_HDR_CHKSUM_MASK == chksum
+
 def parse_multibyte_header(h):
     fd = FieldDecoder([h])
     size = fd.decode_field(MB_HDR_FIELD_WIDTH_SIZE)
@@ -111,15 +354,92 @@ class FieldDecoder:
 
         return field
 
+# Returns kind, flags, and the rest of an energy profile payload, with a
+# progressive profile converted to the layout of a plain one
+def parse_profile_pkt(payload):
+    kind, flags, payload = parse_pkt_tag(payload)
+    if kind == PKT_KIND_PROFILE_PROGRESSIVE:
+        payload = profile_planes_to_plain(payload) + list(payload[PROFILE_SIZE:])
+    return kind, flags, payload
+
+# Returns the flags, (count, bins) per event, the bin edge byte, and the duty
+# cycle byte (None if not in the pkt), from a profile pkt of either kind (raw
+# counter values)
+def parse_profile(payload):
+    kind, flags, payload = parse_profile_pkt(payload)
+    field_dec = FieldDecoder(payload)
+    events = []
+    for i in range(PROFILE_NUM_EVENTS):
+        bins = [field_dec.decode_field(PROFILE_FIELD_WIDTH_BIN) for j in range(PROFILE_BINS)]
+        count = field_dec.decode_field(PROFILE_FIELD_WIDTH_COUNT)
+        events.append((count, bins))
+    edge = None
+    duty = None
+    if flags & PKT_FLAG_PROFILE_EDGES:
+        edge = field_dec.decode_field(PROFILE_FIELD_WIDTH_EDGE)
+    elif len(payload) > PROFILE_SIZE:
+        duty = field_dec.decode_field(PROFILE_FIELD_WIDTH_DUTY)
+    return flags, events, edge, duty
+
+# Returns (temp, mag axes, accel axes) per window of app output
+def parse_app_output(payload):
+    field_dec = FieldDecoder(payload)
+    windows = []
+    for i in range(APPOUT_NUM_WINDOWS):
+        temp = twocomp(field_dec.decode_field(APPOUT_FIELD_WIDTH_TEMP), APPOUT_FIELD_WIDTH_TEMP)
+        m = [twocomp(field_dec.decode_field(APPOUT_FIELD_WIDTH_MAG), APPOUT_FIELD_WIDTH_MAG)
+                for j in range(APPOUT_NUM_AXES_MAG)]
+        a = [twocomp(field_dec.decode_field(APPOUT_FIELD_WIDTH_ACCEL), APPOUT_FIELD_WIDTH_ACCEL)
+                for j in range(APPOUT_NUM_AXES_ACCEL)]
+        windows.append((temp, m, a))
+    return windows
+
+# Returns kind, flags, and the rest of an energy profile payload
+def parse_pkt_tag(payload):
+    if len(payload) == PROFILE_SIZE: # untagged
+        return PKT_KIND_PROFILE, 0, payload
+    fd = FieldDecoder(list(payload[:1]))
+    kind = fd.decode_field(PKT_TAG_FIELD_WIDTH_KIND)
+    flags = fd.decode_field(PKT_TAG_FIELD_WIDTH_FLAGS)
+    return kind, flags, payload[1:]
+
 
 class Decoder:
 
-    def __init__(self):
+    # reassembly_window: sec to keep a partial pkt without new chunks (None: no limit)
+    # estimates: return the bytes received so far of a progressive profile
+    #            (PKT_TYPE_PROFILE_ESTIMATE), each time a chunk extends them
+    def __init__(self, metrics=None, reassembly_window=None, clock=time.time, estimates=False):
 
         self.state = STATE_NONE
-        self.payload_state = PAYLOAD_STATE_NONE
+        self.estimates = estimates
+
+        self.reassembler = Reassembler(verify_payload, window=reassembly_window,
+                                       clock=clock, on_error=self.reassembly_error)
+
+        self.metrics = metrics
+
+        # Pkts completed by the same chunk as the one decode() returned
+        self.completed = []
+
+    # Returns the pkts that the last chunk completed besides the one returned
+    # by decode() (more than one if a corrupt header chunk passed as valid)
+    def take_completed(self):
+        pkts = self.completed
+        self.completed = []
+        return pkts
+
+    def reassembly_error(self, kind, *args):
+        print_err(*args)
+        self.count_error(kind)
 
-        self.payload = []
+    def count_error(self, kind):
+        if self.metrics is not None:
+            self.metrics.count_error(kind)
+
+    def count_pkt(self, pkt_type):
+        if self.metrics is not None:
+            self.metrics.count_pkt(PKT_TYPE_NAME[pkt_type])
 
 
     def decode(self, b):
@@ -127,9 +447,28 @@ class Decoder:
         #print("BYTE: %02x" % b)
 
         if b == BEACON:
-            self.state = STATE_NONE
+            self.state = STATE_BEACON
+            self.count_pkt(PKT_TYPE_BEACON)
             return PKT_TYPE_BEACON, [b]
 
+        elif self.state == STATE_BEACON:
+            if not is_beacon_status(b, 0): # beacon without status
+                self.state = STATE_NONE
+                return b # put back
+
+            self.status_raw = b
+            self.state = STATE_BEACON_STATUS
+
+        elif self.state == STATE_BEACON_STATUS:
+            self.state = STATE_NONE
+
+            if not verify_beacon_status(self.status_raw, b):
+                self.decode(self.status_raw) # as chunk, fails on idx
+                return b # put back
+
+            self.count_pkt(PKT_TYPE_BEACON_STATUS)
+            return PKT_TYPE_BEACON_STATUS, [self.status_raw, b]
+
         elif self.state == STATE_NONE:
 
             self.hdr_raw = b
@@ -141,6 +480,7 @@ class Decoder:
 
             if self.pkt_type not in [PKT_TYPE_ENERGY_PROFILE, PKT_TYPE_APP_OUTPUT]:
                 print_err("invalid pkt type: ", self.pkt_type)
+                self.count_error(ERR_INVALID_TYPE)
                 return
 
             self.state = STATE_HDR
@@ -152,70 +492,71 @@ class Decoder:
 
             if actual_chksum != self.pkt_chksum:
                 print_err("payload chunk chksum mismatch: %02x (expected %02x)" % (actual_chksum, self.pkt_chksum))
+                self.count_error(ERR_CHUNK_CHKSUM)
                 self.state = STATE_NONE
                 return b # put back
 
-            if self.payload_state == PAYLOAD_STATE_NONE:
+            self.state = STATE_NONE
 
-                self.payload_chksum, self.payload_size = parse_multibyte_header(data_byte)
+            if self.pkt_idx == 0: # header of multibyte pkt
+                payload_chksum, payload_size = parse_multibyte_header(data_byte)
 
                 # This check is optional
-                if self.payload_size != PKT_SIZE_BY_TYPE[self.pkt_type]:
-                    print_err("payload size mismatch:", self.payload_size, "(expected", PKT_SIZE_BY_TYPE[self.pkt_type], ")")
-
-                    if self.payload_state == PAYLOAD_STATE_HDR:
-                        self.payload_state = PAYLOAD_STATE_HDR_RETRY
-                    elif self.payload_state == PAYLOAD_STATE_HDR_RETRY:
-                        self.payload_state = PAYLOAD_STATE_NONE
-
+                if payload_size not in PKT_SIZES_BY_TYPE[self.pkt_type]:
+                    print_err("payload size mismatch:", payload_size, "(expected", PKT_SIZES_BY_TYPE[self.pkt_type], ")")
+                    self.count_error(ERR_PAYLOAD_SIZE)
                     return
 
-                self.payload_type = self.pkt_type
-                self.payload = []
-                self.payload_state = PAYLOAD_STATE_DATA
-
-            elif self.payload_state in [PAYLOAD_STATE_DATA, PAYLOAD_STATE_DATA_RETRY]:
-
-                if self.payload_type != self.pkt_type:
-                    print_err("payload chunk type mismatch:", self.pkt_type, "(expected", self.payload_type, ")")
-
-                    #self.payload_state = PAYLOAD_STATE_NONE # TODO
-                    if self.payload_state == PAYLOAD_STATE_DATA:
-                        self.payload_state = PAYLOAD_STATE_DATA_RETRY
-                    elif self.payload_state == PAYLOAD_STATE_DATA_RETRY:
-                        self.payload_state = PAYLOAD_STATE_NONE
-
-                    self.state = STATE_NONE
-                    return b # put back
-
-                if self.pkt_idx != len(self.payload) + 1: # +1 for header of multibyte pkt
-                    print_err("payload chunk idx mismatch:", self.pkt_idx, "(expected", len(self.payload), ")")
-                    #self.payload_state = PAYLOAD_STATE_NONE # TODO
-
-                    if self.payload_state == PAYLOAD_STATE_DATA:
-                        self.payload_state = PAYLOAD_STATE_DATA_RETRY
-                    elif self.payload_state == PAYLOAD_STATE_DATA_RETRY:
-                        self.payload_state = PAYLOAD_STATE_NONE
-
-                    self.state = STATE_NONE
-                    return b # put back
-
-                self.payload.append(data_byte)
-
-                if len(self.payload) == self.payload_size:
-
-                    actual_chksum = crc(self.payload) & MB_HDR_CHKSUM_MASK
-                    if self.payload_chksum != actual_chksum:
-                        print_err("payload chksum mismatch:", actual_chksum, "(expected", self.payload_chksum, ")")
-                        self.payload_state = PAYLOAD_STATE_NONE
-                        return
+                self.reassembler.add_header(self.pkt_type, payload_size, payload_chksum)
+                return
 
-                    print("pkt decoded: type", self.payload_type, "payload", self.payload);
-                    self.payload_state = PAYLOAD_STATE_NONE
-                    return self.payload_type, self.payload
-                elif len(self.payload) > self.payload_size: # TODO: shouldn't happen
-                    self.payload_state = PAYLOAD_STATE_NONE
+            pkts = self.reassembler.add_chunk(self.pkt_type, self.pkt_idx, data_byte)
+            for payload_type, payload in pkts:
+                print("pkt decoded: type", payload_type, "payload", payload);
+                self.count_pkt(payload_type)
+            if len(pkts) > 0:
+                self.completed.extend(pkts[1:])
+                return pkts[0]
 
-            self.state = STATE_NONE
+            if self.estimates:
+                return self.profile_estimate()
 
         return None
+
+    # Prefix of a progressive profile, if the last chunk extended it. Not
+    # verified against the payload checksum, which needs all chunks.
+    def profile_estimate(self):
+        if self.reassembler.last_added is None:
+            return None
+        p, slot = self.reassembler.last_added
+        if p.pkt_type != PKT_TYPE_ENERGY_PROFILE or p.size == PROFILE_SIZE: # untagged
+            return None
+        prefix = []
+        for b in p.slots[:1 + PROFILE_SIZE]:
+            if b is None:
+                break
+            prefix.append(b)
+        if slot == 0 or slot >= len(prefix): # tag alone, or not contiguous
+            return None
+        if parse_pkt_tag(prefix[:1])[0] != PKT_KIND_PROFILE_PROGRESSIVE:
+            return None
+        self.count_pkt(PKT_TYPE_PROFILE_ESTIMATE)
+        return PKT_TYPE_PROFILE_ESTIMATE, prefix
+
+# Decodes a complete byte stream, returns the list of (type, payload) decoded
+def decode_all(data, decoder=None):
+    if decoder is None:
+        decoder = Decoder()
+    decoded = []
+    inbuf = list(data[::-1])
+    while len(inbuf) > 0:
+        b = inbuf.pop()
+        pkt = decoder.decode(b)
+        if pkt is None:
+            continue
+        if pkt == b: # put back
+            inbuf.append(b)
+            continue
+        decoded.append(pkt)
+        decoded.extend(decoder.take_completed())
+    return decoded
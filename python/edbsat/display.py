@@ -6,10 +6,23 @@ import argparse
 import os
 import fcntl
 import time
+import threading
+
+# Max number of unchanged cells between changed cells to coalesce into one run
+RUN_MERGE_GAP = 4
+
+# Cursor move escape (row, col), as sent by ScreenContext.set_cursor_loc
+CURSOR_LOC = "\033[%d;%dH"
 
 class Display:
+    """Byte and packet log on ODROIDshow LCD.
 
-    def __init__(self, port):
+    The show_* methods only update an in-memory framebuffer. A render thread
+    flushes the cells that changed since the last frame to the screen at a
+    bounded frame rate, so that a slow screen does not stall the caller.
+    """
+
+    def __init__(self, port, fps=2):
 
         self.ctx = ScreenContext(port)
 
@@ -18,8 +31,11 @@ class Display:
         # Wait 6 seconds for the screen to boot up before we start uploading anything
         self.ctx.sleep(6).reset_lcd().set_rotation(Screen.HORIZONTAL)
 
-        self.bytes_rows = self.ctx.get_rows() // 2
-        self.pkts_rows = self.ctx.get_rows() - self.bytes_rows
+        self.rows = self.ctx.get_rows()
+        self.cols = self.ctx.get_columns()
+
+        self.bytes_rows = self.rows // 2
+        self.pkts_rows = self.rows - self.bytes_rows
 
 
         self.bytes_header = 1
@@ -34,65 +50,112 @@ class Display:
 
         self.ctx.home()
 
-        print("bytes rows=", self.bytes_rows, "off=", self.cursor_bytes_offset)
-        print("pkts rows=", self.pkts_rows, "off=", self.cursor_pkts_offset)
-
         # Header
         self.ctx.bg_color(Screen.BLUE).fg_color(Screen.WHITE).write_line('Bytes')
         self.ctx.bg_color(Screen.BLACK)
 
-        #time.sleep(5)
-
-        print("p loc ", self.bytes_rows, 0)
         self.ctx.set_cursor_loc(self.bytes_rows, 0)
         self.ctx.bg_color(Screen.BLUE).fg_color(Screen.WHITE).write_line('Packets')
         self.ctx.bg_color(Screen.BLACK)
 
-        #time.sleep(5)
+        # Framebuffer (what we want on screen) and what is on screen now.
+        # Header rows are never written into the framebuffer, so never redrawn.
+        self.fb = [[' '] * self.cols for r in range(self.rows)]
+        self.shown = [[' '] * self.cols for r in range(self.rows)]
+        self.fb_lock = threading.Lock()
 
+        self.frame_interval = 1.0 / fps
+        self.render_thread = threading.Thread(target=self.render, daemon=True)
+        self.render_thread.start()
 
-    def show_bytes(self, d):
-
-        for b in bytearray(d):
-            s = "%02x " % b
+    def fb_write(self, row, col, s):
+        # caller holds fb_lock
+        if row >= self.rows:
+            return
+        for i, c in enumerate(s[:self.cols - col]):
+            self.fb[row][col + i] = c
 
-            if self.cursor_bytes_col + len(s) > self.ctx.get_columns():
-                self.cursor_bytes_col = 0
-                self.cursor_bytes_row = (self.cursor_bytes_row + 1) % (self.bytes_rows - self.bytes_header) # 1+ and -1 for header
-                if self.cursor_bytes_row == 0:
-                    row = 0
-                    for i in range(self.bytes_rows - self.bytes_header):
-                        self.ctx.set_cursor_loc(self.cursor_bytes_offset + row, 0)
-                        self.ctx.write(' ' * self.ctx.get_columns())
-                        row += 1
+    def fb_clear_rows(self, first_row, num_rows):
+        # caller holds fb_lock
+        for r in range(first_row, first_row + num_rows):
+            self.fb[r] = [' '] * self.cols
 
-            self.ctx.set_cursor_loc(self.cursor_bytes_offset + self.cursor_bytes_row, self.cursor_bytes_col)
-            print("b loc ", self.cursor_bytes_offset + self.cursor_bytes_row, self.cursor_bytes_col)
-
-            self.ctx.write(s)
-            self.cursor_bytes_col += len(s)
+    def show_bytes(self, d):
+        with self.fb_lock:
+            for b in bytearray(d):
+                s = "%02x " % b
+
+                if self.cursor_bytes_col + len(s) > self.cols:
+                    self.cursor_bytes_col = 0
+                    self.cursor_bytes_row = (self.cursor_bytes_row + 1) % (self.bytes_rows - self.bytes_header) # 1+ and -1 for header
+                    if self.cursor_bytes_row == 0:
+                        self.fb_clear_rows(self.cursor_bytes_offset, self.bytes_rows - self.bytes_header)
+
+                self.fb_write(self.cursor_bytes_offset + self.cursor_bytes_row, self.cursor_bytes_col, s)
+                self.cursor_bytes_col += len(s)
+
+    def pkts_make_room(self, lines):
+        # caller holds fb_lock
+        if self.cursor_pkts_row + lines > (self.pkts_rows - self.pkts_header):
+            self.cursor_pkts_row = 0
+            self.cursor_pkts_col = 0
+            self.fb_clear_rows(self.cursor_pkts_offset, self.pkts_rows - self.pkts_header)
 
     def show_pkt(self, pkt):
         # pkt is just one or more lines of text
-        if self.cursor_pkts_col + len(pkt) + 1 > self.ctx.get_columns(): # +1 for leading space
-            pkt_lines = len(pkt) // self.ctx.get_columns() + 1
-
-            if self.cursor_pkts_row + pkt_lines > (self.pkts_rows - self.pkts_header):
-                self.cursor_pkts_row = 0
-                self.ctx.set_cursor_loc(self.cursor_pkts_offset, 0)
-                for i in range(self.pkts_rows - self.pkts_header):
-                    self.ctx.write_line(' ' * self.ctx.get_columns())
-
-            self.ctx.set_cursor_loc(self.cursor_pkts_offset + self.cursor_pkts_row, 0)
-            print("p loc ", self.cursor_pkts_offset + self.cursor_pkts_row, 0)
-            self.ctx.write_line(pkt)
-            print("line ", pkt)
-
-            #self.cursor_pkts_col = len(pkt) % self.ctx.get_columns()
-            self.cursor_pkts_col = 0
-            self.cursor_pkts_row += pkt_lines
-        else:
-            pkt = " " + pkt
-            self.ctx.set_cursor_loc(self.cursor_pkts_offset + self.cursor_pkts_row, self.cursor_pkts_col)
-            self.ctx.write(pkt)
-            self.cursor_pkts_col += len(pkt)
+        with self.fb_lock:
+            if self.cursor_pkts_col + len(pkt) + 1 > self.cols: # +1 for leading space
+                pkt_lines = len(pkt) // self.cols + 1
+                self.pkts_make_room(pkt_lines)
+
+                for i in range(pkt_lines):
+                    row = self.cursor_pkts_offset + self.cursor_pkts_row + i
+                    if row >= self.rows:
+                        break
+                    line = pkt[i * self.cols:(i + 1) * self.cols]
+                    self.fb_write(row, 0, line.ljust(self.cols))
+
+                self.cursor_pkts_col = 0
+                self.cursor_pkts_row += pkt_lines
+            else:
+                self.pkts_make_room(1) # cursor may be past the last row
+                pkt = " " + pkt
+                self.fb_write(self.cursor_pkts_offset + self.cursor_pkts_row, self.cursor_pkts_col, pkt)
+                self.cursor_pkts_col += len(pkt)
+
+    def diff(self):
+        """Returns runs of changed cells as (row, col, text), and marks them shown"""
+        runs = []
+        with self.fb_lock:
+            for r in range(self.rows):
+                fb_row, shown_row = self.fb[r], self.shown[r]
+                c = 0
+                while c < self.cols:
+                    if fb_row[c] == shown_row[c]:
+                        c += 1
+                        continue
+                    # Extend the run over short stretches of unchanged cells,
+                    # since re-sending them is cheaper than a cursor move
+                    start = end = c
+                    while c < self.cols and c - end <= RUN_MERGE_GAP:
+                        if fb_row[c] != shown_row[c]:
+                            end = c + 1
+                        c += 1
+                    runs.append((r, start, "".join(fb_row[start:end])))
+                self.shown[r] = list(fb_row)
+        return runs
+
+    def render(self):
+        while True:
+            frame_start = time.time()
+
+            # Screen I/O happens outside the lock, so producers never wait on
+            # it, and in one write per frame, cursor moves included
+            frame = "".join(CURSOR_LOC % (row, col) + text
+                            for row, col, text in self.diff())
+            if len(frame) > 0:
+                self.ctx.write(frame)
+
+            elapsed = time.time() - frame_start
+            if elapsed < self.frame_interval:
+                time.sleep(self.frame_interval - elapsed)
@@ -0,0 +1,26 @@
+from edbsat.decoder import *
+
+# Encodes payloads into the byte stream transmitted by the firmware, one
+# rad_pkt_t chunk per transmission (see transmit_saved_payload() and
+# payload_send_pkt() in edb-sat/src/payload.c)
+
+# rad_pkt_t: idx:4 type:1 chksum:3, payload_byte; chksum is over the raw
+# chunk with the chksum bits zeroed
+def encode_chunk(pkt_type, idx, data_byte):
+    hdr = (idx << shift(PKT_IDX_MASK)) | (pkt_type << shift(PKT_TYPE_MASK))
+    chksum = crc([hdr, data_byte]) & (PKT_CHKSUM_MASK >> shift(PKT_CHKSUM_MASK))
+    return [hdr | (chksum << shift(PKT_CHKSUM_MASK)), data_byte]
+
+# multibyte_pkt_hdr_t: size:4 chksum:4
+def encode_multibyte_header(payload):
+    chksum = crc(payload) & MB_HDR_CHKSUM_MASK
+    return len(payload) | (chksum << MB_HDR_FIELD_WIDTH_SIZE)
+
+# Returns the list of chunks (idx 0 is the multibyte pkt header)
+def encode_pkt(pkt_type, payload):
+    if not 0 < len(payload) < 2**MB_HDR_FIELD_WIDTH_SIZE:
+        raise Exception("Invalid payload size: %u" % len(payload))
+    chunks = [encode_chunk(pkt_type, 0, encode_multibyte_header(payload))]
+    for i, b in enumerate(payload):
+        chunks.append(encode_chunk(pkt_type, i + 1, b))
+    return chunks
@@ -0,0 +1,206 @@
+import os
+import socket
+import threading
+import time
+from collections import deque
+
+# Kinds of decoder failures, one counter each (see Decoder.decode)
+ERR_INVALID_TYPE   = "invalid_type"
+ERR_CHUNK_CHKSUM   = "chunk_chksum"
+ERR_PAYLOAD_SIZE   = "payload_size"
+ERR_IDX_MISMATCH   = "idx_mismatch"
+ERR_ORPHAN_CHUNK   = "orphan_chunk"
+ERR_PAYLOAD_CHKSUM = "payload_chksum"
+ERR_REASSEMBLY_EXPIRED = "reassembly_expired"
+ERR_REASSEMBLY_SUPERSEDED = "reassembly_superseded"
+ERR_REASSEMBLY_EVICTED = "reassembly_evicted"
+
+ERR_KINDS = [
+    ERR_INVALID_TYPE,
+    ERR_CHUNK_CHKSUM,
+    ERR_PAYLOAD_SIZE,
+    ERR_IDX_MISMATCH,
+    ERR_ORPHAN_CHUNK,
+    ERR_PAYLOAD_CHKSUM,
+    ERR_REASSEMBLY_EXPIRED,
+    ERR_REASSEMBLY_SUPERSEDED,
+    ERR_REASSEMBLY_EVICTED,
+]
+
+RATE_WINDOW = 60 # seconds, for the per-minute rates
+
+PREFIX = "edbsat_decoder_"
+
+class RateWindow:
+    """Count of events in the last RATE_WINDOW seconds, in 1-second buckets"""
+
+    def __init__(self, window=RATE_WINDOW):
+        self.window = window
+        self.buckets = deque() # [second, count]
+
+    def add(self, now, n=1):
+        sec = int(now)
+        if len(self.buckets) > 0 and self.buckets[-1][0] == sec:
+            self.buckets[-1][1] += n
+        else:
+            self.buckets.append([sec, n])
+        self.expire(now)
+
+    def expire(self, now):
+        while len(self.buckets) > 0 and self.buckets[0][0] <= int(now) - self.window:
+            self.buckets.popleft()
+
+    def rate(self, now):
+        self.expire(now)
+        return sum(c for s, c in self.buckets) * 60.0 / self.window
+
+
+class DecoderMetrics:
+    """Aggregates link-quality and decoder counters.
+
+    Updated from the decode loop, read from the exporter thread, hence the lock.
+    """
+
+    def __init__(self, clock=time.time):
+        self.clock = clock
+        self.lock = threading.Lock()
+
+        self.errors = dict((k, 0) for k in ERR_KINDS)
+        self.bytes = 0
+        self.pkts = {}
+        self.put_backs = 0
+        self.ring_dropped = 0 # frames dropped by the receiver, ring full
+
+        self.bytes_window = RateWindow()
+        self.pkts_window = RateWindow()
+
+        # Resync latency: time from the first error after a good packet to
+        # the next good packet
+        self.sync_lost_at = None
+        self.resyncs = 0
+        self.resync_latency_sum = 0.0
+        self.resync_latency_last = 0.0
+
+    def count_byte(self, n=1):
+        with self.lock:
+            self.bytes += n
+            self.bytes_window.add(self.clock(), n)
+
+    def set_ring_dropped(self, n):
+        with self.lock:
+            self.ring_dropped = n
+
+    def count_error(self, kind):
+        with self.lock:
+            self.errors[kind] += 1
+            if self.sync_lost_at is None:
+                self.sync_lost_at = self.clock()
+
+    def count_put_back(self):
+        with self.lock:
+            self.put_backs += 1
+
+    def count_pkt(self, type_name):
+        with self.lock:
+            now = self.clock()
+            self.pkts[type_name] = self.pkts.get(type_name, 0) + 1
+            self.pkts_window.add(now)
+            if self.sync_lost_at is not None:
+                latency = now - self.sync_lost_at
+                self.resyncs += 1
+                self.resync_latency_sum += latency
+                self.resync_latency_last = latency
+                self.sync_lost_at = None
+
+    def format(self):
+        """Render in Prometheus text exposition format"""
+        with self.lock:
+            now = self.clock()
+            lines = []
+
+            def metric(name, kind, help_str, samples):
+                lines.append("# HELP %s%s %s" % (PREFIX, name, help_str))
+                lines.append("# TYPE %s%s %s" % (PREFIX, name, kind))
+                for labels, v in samples:
+                    if labels:
+                        label_str = ",".join('%s="%s"' % kv for kv in labels)
+                        lines.append("%s%s{%s} %s" % (PREFIX, name, label_str, v))
+                    else:
+                        lines.append("%s%s %s" % (PREFIX, name, v))
+
+            metric("errors_total", "counter", "Decoder failures by kind",
+                   [([("kind", k)], self.errors[k]) for k in ERR_KINDS])
+            metric("bytes_total", "counter", "Received bytes",
+                   [(None, self.bytes)])
+            metric("packets_total", "counter", "Decoded packets by type",
+                   [([("type", t)], c) for t, c in sorted(self.pkts.items())])
+            metric("put_backs_total", "counter", "Bytes put back for re-decoding",
+                   [(None, self.put_backs)])
+            metric("ring_dropped_frames_total", "counter",
+                   "Frames dropped by the receiver because the ring was full",
+                   [(None, self.ring_dropped)])
+            metric("bytes_per_minute", "gauge", "Received bytes in the last minute",
+                   [(None, "%.1f" % self.bytes_window.rate(now))])
+            metric("packets_per_minute", "gauge", "Decoded packets in the last minute",
+                   [(None, "%.1f" % self.pkts_window.rate(now))])
+            metric("resync_latency_seconds", "summary",
+                   "Time from loss of sync to the next decoded packet", [])
+            lines.append("%sresync_latency_seconds_sum %.3f" % (PREFIX, self.resync_latency_sum))
+            lines.append("%sresync_latency_seconds_count %u" % (PREFIX, self.resyncs))
+            metric("resync_latency_last_seconds", "gauge", "Latency of the last resync",
+                   [(None, "%.3f" % self.resync_latency_last)])
+            metric("out_of_sync", "gauge", "Whether decoder has failed since last packet",
+                   [(None, int(self.sync_lost_at is not None))])
+
+            return "\n".join(lines) + "\n"
+
+
+class MetricsExporter:
+    """Periodically exports metrics to a file, or serves them on a Unix socket.
+
+    Destination is a file path, or 'unix:<path>' for a socket: each
+    connection receives one snapshot and is closed.
+    """
+
+    def __init__(self, metrics, dest, interval=10):
+        self.metrics = metrics
+        self.interval = interval
+
+        if dest.startswith("unix:"):
+            self.sock_path = dest[len("unix:"):]
+            self.file_path = None
+            target = self.serve
+        else:
+            self.sock_path = None
+            self.file_path = dest
+            target = self.write_periodically
+
+        self.thread = threading.Thread(target=target, daemon=True)
+        self.thread.start()
+
+    def write(self):
+        # Write to a temp file and rename, so that readers never see a partial file
+        tmp_path = self.file_path + ".tmp"
+        with open(tmp_path, "w") as f:
+            f.write(self.metrics.format())
+        os.rename(tmp_path, self.file_path)
+
+    def write_periodically(self):
+        while True:
+            self.write()
+            time.sleep(self.interval)
+
+    def serve(self):
+        if os.path.exists(self.sock_path):
+            os.unlink(self.sock_path)
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.bind(self.sock_path)
+        sock.listen(1)
+        while True:
+            conn, addr = sock.accept()
+            try:
+                conn.sendall(self.metrics.format().encode())
+            except OSError:
+                pass
+            finally:
+                conn.close()
@@ -0,0 +1,42 @@
+#!/usr/bin/python
+
+import argparse
+import time
+
+from edbsat.aggregate import *
+
+parser = argparse.ArgumentParser(
+    description="Report mission-level aggregates of decoded packets, from the " + \
+                "snapshot kept by the decoder (edbsat-decode --aggregates)")
+parser.add_argument('snapshot',
+    help="Aggregates snapshot file")
+parser.add_argument('--days', type=int,
+    help="Only the last N days (UTC) up to the last packet, instead of all")
+parser.add_argument('--watchpoint', '-w', type=int, action='append',
+    help="Report only this watchpoint (may be repeated)")
+args = parser.parse_args()
+
+agg = load_aggregates(args.snapshot)
+r = agg.query(args.days)
+
+def fmt_time(t):
+    return "-" if t is None else time.strftime("%Y-%m-%d %H:%M:%S", time.gmtime(t))
+
+def fmt_num(v, fmt="%.2f"):
+    return "-" if v is None else fmt % v
+
+print("span %s .. %s%s" % (fmt_time(agg.first), fmt_time(agg.last),
+      "" if args.days is None else " (last %u days)" % args.days))
+print("profiles %u" % r.profiles)
+
+watchpoints = args.watchpoint if args.watchpoint else range(PROFILE_NUM_EVENTS)
+for i in watchpoints:
+    c = r.counts[i]
+    print("wp %u: events/profile mean %s sd %s max %s | bins %s" % (i,
+          fmt_num(c.mean()), fmt_num(c.stdev()), fmt_num(c.max, "%u"),
+          ":".join(fmt_num(f, "%.3f") for f in r.bin_fractions(i))))
+
+print("app_pkts %u" % r.app_pkts)
+for name, s in zip(APP_FIELDS, r.app):
+    print("%s: mean %s sd %s min %s max %s" % (name, fmt_num(s.mean()),
+          fmt_num(s.stdev()), fmt_num(s.min, "%d"), fmt_num(s.max, "%d")))
@@ -0,0 +1,147 @@
+import time
+
+from edbsat.metrics import (ERR_IDX_MISMATCH, ERR_ORPHAN_CHUNK, ERR_PAYLOAD_CHKSUM,
+                            ERR_REASSEMBLY_EXPIRED, ERR_REASSEMBLY_SUPERSEDED,
+                            ERR_REASSEMBLY_EVICTED)
+
+MAX_PARTIALS = 8 # partial pkts kept at once, oldest dropped first
+
+# Why a partial pkt was dropped, by error kind
+DROP_REASONS = {
+    ERR_REASSEMBLY_EXPIRED: "expired",
+    ERR_REASSEMBLY_SUPERSEDED: "superseded",
+    ERR_REASSEMBLY_EVICTED: "evicted",
+}
+
+class Partial:
+    """Payload of a multibyte pkt with some chunks received"""
+
+    def __init__(self, pkt_type, size, chksum, now):
+        self.pkt_type = pkt_type
+        self.size = size
+        self.chksum = chksum
+        self.slots = [None] * size # payload byte at each idx, if received
+        self.started = now
+        self.updated = now
+
+    def key(self):
+        return self.pkt_type, self.size, self.chksum
+
+    def complete(self):
+        return all(b is not None for b in self.slots)
+
+    # Slot after the last filled one: chunks are sent in idx order
+    def next_slot(self):
+        filled = [i for i, b in enumerate(self.slots) if b is not None]
+        return filled[-1] + 1 if len(filled) > 0 else 0
+
+
+class Reassembler:
+    """Collects the chunks of multibyte pkts into payloads.
+
+    Partial pkts are identified by (type, size, payload checksum) from the
+    header chunk, and are kept across gaps in the chunk sequence, until
+    complete, superseded by a newer pkt, or idle for longer than 'window'
+    seconds (None to keep until evicted).
+
+    Chunks carry only (type, idx), so a data chunk goes to each partial pkt
+    of its type that it continues in idx order (more than one if a corrupt
+    header chunk passed as valid), or else fills the slot at its idx in the
+    most recently started one.
+    """
+
+    # verify(payload, chksum) checks the payload against the header checksum
+    def __init__(self, verify, window=None, clock=time.time, on_error=None):
+        self.verify = verify
+        self.window = window
+        self.clock = clock
+        self.on_error = on_error
+        self.partials = [] # ordered by start time
+        self.last_added = None # (partial, slot) filled by the last chunk, if any
+
+    def error(self, kind, *args):
+        if self.on_error is not None:
+            self.on_error(kind, *args)
+
+    # kind: one of DROP_REASONS
+    def drop(self, p, kind):
+        self.error(kind, "partial pkt %s:" % DROP_REASONS[kind], p.key(),
+                   "chunks", sum(b is not None for b in p.slots), "of", p.size)
+        self.partials.remove(p)
+
+    def expire(self, now):
+        if self.window is None:
+            return
+        for p in [p for p in self.partials if now - p.updated > self.window]:
+            self.drop(p, ERR_REASSEMBLY_EXPIRED)
+
+    def add_header(self, pkt_type, size, chksum):
+        now = self.clock()
+        self.expire(now)
+
+        for p in self.partials:
+            if p.key() == (pkt_type, size, chksum): # pkt header sent again
+                p.updated = now
+                return
+
+        if len(self.partials) == MAX_PARTIALS:
+            self.drop(self.partials[0], ERR_REASSEMBLY_EVICTED)
+        self.partials.append(Partial(pkt_type, size, chksum, now))
+
+    # Returns the list of (type, payload) of the pkts that the chunk completes
+    def add_chunk(self, pkt_type, idx, data_byte):
+        now = self.clock()
+        self.expire(now)
+        self.last_added = None
+
+        slot = idx - 1 # idx 0 is the header of the multibyte pkt
+
+        of_type = [p for p in reversed(self.partials) if p.pkt_type == pkt_type]
+        if len(of_type) == 0:
+            self.error(ERR_ORPHAN_CHUNK, "no partial pkt for chunk: type", pkt_type, "idx", idx)
+            return []
+
+        in_range = [p for p in of_type if slot < p.size]
+        if len(in_range) == 0:
+            self.error(ERR_IDX_MISMATCH, "chunk idx beyond partial pkts:", idx)
+            return []
+
+        targets = [p for p in in_range if p.next_slot() == slot]
+        if len(targets) > 0:
+            # Pkts are sent one after the other, so older pkts that this
+            # chunk doesn't continue will not get any more chunks
+            newest = self.partials.index(targets[0])
+            for p in [p for p in self.partials[:newest]
+                        if p.pkt_type == pkt_type and p not in targets]:
+                self.drop(p, ERR_REASSEMBLY_SUPERSEDED)
+        else: # chunks in between were lost, or this one was corrupted
+            p = in_range[0]
+            if p.slots[slot] is None:
+                targets = [p]
+            elif p.slots[slot] != data_byte:
+                # A new pkt whose header chunk was lost: can't place its chunks
+                self.drop(p, ERR_REASSEMBLY_SUPERSEDED)
+                self.error(ERR_ORPHAN_CHUNK, "chunk conflicts with partial pkt: idx", idx)
+                return []
+
+        # Every target gets the chunk, even once one of them is complete
+        completed = []
+        for p in targets:
+            pkt = self.add_to_partial(p, slot, data_byte, now)
+            if pkt is not None:
+                completed.append(pkt)
+        return completed
+
+    def add_to_partial(self, p, slot, data_byte, now):
+        p.slots[slot] = data_byte
+        p.updated = now
+        self.last_added = (p, slot)
+
+        if not p.complete():
+            return None
+
+        self.partials.remove(p)
+        if not self.verify(p.slots, p.chksum):
+            self.error(ERR_PAYLOAD_CHKSUM, "payload chksum mismatch:", p.key())
+            return None
+        return p.pkt_type, p.slots
@@ -0,0 +1,215 @@
+import mmap
+import os
+import struct
+import time
+import zlib
+
+# Single-producer single-consumer ring of timestamped byte frames in a shared
+# memory file (e.g. in /dev/shm), from the SDR receiver to the decoder.
+#
+# Layout: header, then the producer and consumer positions on separate cache
+# lines, then the data area. Positions are free-running byte counters (mod
+# 2^32) into the data area, written only by their owner, so no locks.
+#
+# A frame is a header (position, length, flags, timestamp, checksum) followed
+# by the bytes, padded to FRAME_ALIGN. Frames do not wrap around the end of
+# the data area: a frame with FRAME_FLAG_WRAP fills the rest of it instead.
+#
+# Python has no memory fences, so on a weakly ordered CPU the consumer could
+# see the producer position advance before the frame contents, or only part
+# of them. Each frame carries its own position and a CRC32 of its header and
+# bytes, and the consumer takes a frame only once both match, or else
+# retries on the next wakeup.
+
+RING_MAGIC = 0x52424445 # 'EDBR'
+RING_VERSION = 2
+
+RING_DEFAULT_CAPACITY = 1 << 16 # bytes of data area, a power of 2
+RING_POLL_INTERVAL = 0.05 # sec between checks for new frames when idle
+
+HEADER_FMT = "<IHHII" # magic, version, reserved, capacity, dropped frames
+DROPPED_OFFSET = 12
+HEAD_OFFSET = 64 # producer position
+TAIL_OFFSET = 128 # consumer position
+DATA_OFFSET = 192
+
+FRAME_FMT = "<IHHdI" # position, length, flags, timestamp (sec since epoch), CRC32
+FRAME_CHKSUM_FMT = FRAME_FMT[:-1] # the header fields covered by the checksum
+FRAME_HEADER_SIZE = struct.calcsize(FRAME_FMT)
+FRAME_ALIGN = 32 # so that the room left at the end fits a wrap frame
+FRAME_FLAG_WRAP = 0x0001
+
+POS_MASK = 0xFFFFFFFF
+
+def frame_size(length):
+    return (FRAME_HEADER_SIZE + length + FRAME_ALIGN - 1) & ~(FRAME_ALIGN - 1)
+
+def frame_chksum(pos, length, flags, t, data):
+    return zlib.crc32(data, zlib.crc32(struct.pack(FRAME_CHKSUM_FMT, pos, length, flags, t)))
+
+class Ring:
+    """Mapping of the ring file, shared by the writer and the reader"""
+
+    def __init__(self, path, capacity=None):
+        size = None if capacity is None else DATA_OFFSET + capacity
+        fd = os.open(path, os.O_RDWR | (os.O_CREAT if size is not None else 0), 0o644)
+        try:
+            if size is not None and os.fstat(fd).st_size != size:
+                os.ftruncate(fd, size)
+            self.mem = mmap.mmap(fd, 0)
+        finally:
+            os.close(fd)
+        self.path = path
+
+    def valid(self, capacity=None):
+        magic, version, _, cap, _ = struct.unpack_from(HEADER_FMT, self.mem, 0)
+        return magic == RING_MAGIC and version == RING_VERSION and \
+                (capacity is None or cap == capacity) and \
+                len(self.mem) == DATA_OFFSET + cap
+
+    def capacity(self):
+        return struct.unpack_from(HEADER_FMT, self.mem, 0)[3]
+
+    def dropped(self):
+        return struct.unpack_from(HEADER_FMT, self.mem, 0)[4]
+
+    def get_pos(self, offset):
+        return struct.unpack_from("<I", self.mem, offset)[0]
+
+    def set_pos(self, offset, pos):
+        struct.pack_into("<I", self.mem, offset, pos & POS_MASK)
+
+    def close(self):
+        self.mem.close()
+
+
+class RingWriter:
+    """Producer end: the receiver appends each batch of demodulated bytes.
+
+    Attaches to an existing ring of the same capacity, so that the receiver
+    can restart while the decoder keeps reading. Never blocks: when the ring
+    is full, the frame is dropped and counted in the header.
+    """
+
+    def __init__(self, path, capacity=RING_DEFAULT_CAPACITY):
+        if capacity & (capacity - 1) != 0 or capacity < 4 * FRAME_ALIGN:
+            raise Exception("Ring capacity must be a power of 2 of at least %u" % (4 * FRAME_ALIGN))
+        self.ring = Ring(path, capacity)
+        if not self.ring.valid(capacity):
+            self.ring.set_pos(HEAD_OFFSET, 0)
+            self.ring.set_pos(TAIL_OFFSET, 0)
+            # magic last: the reader waits for it
+            struct.pack_into(HEADER_FMT, self.ring.mem, 0, 0, RING_VERSION, 0, capacity, 0)
+            struct.pack_into("<I", self.ring.mem, 0, RING_MAGIC)
+        self.capacity = capacity
+        self.max_frame = capacity // 4 # bytes of data in one frame
+
+    def write(self, data, t=None):
+        """Append a frame, returns False if it was dropped for lack of space"""
+        if t is None:
+            t = time.time()
+        if len(data) > self.max_frame - FRAME_HEADER_SIZE:
+            raise Exception("Frame too large for ring: %u bytes" % len(data))
+
+        ring = self.ring
+        head = ring.get_pos(HEAD_OFFSET)
+        tail = ring.get_pos(TAIL_OFFSET)
+        free = self.capacity - ((head - tail) & POS_MASK)
+
+        offset = head & (self.capacity - 1)
+        size = frame_size(len(data))
+        room = self.capacity - offset # before the end of the data area
+        pad = room if size > room else 0
+
+        if pad + size > free:
+            ring.set_pos(DROPPED_OFFSET, ring.dropped() + 1)
+            return False
+
+        if pad > 0:
+            struct.pack_into(FRAME_FMT, ring.mem, DATA_OFFSET + offset,
+                             head, 0, FRAME_FLAG_WRAP, t,
+                             frame_chksum(head, 0, FRAME_FLAG_WRAP, t, b""))
+            head = (head + pad) & POS_MASK
+            offset = 0
+
+        start = DATA_OFFSET + offset + FRAME_HEADER_SIZE
+        data = bytes(data)
+        ring.mem[start:start + len(data)] = data
+        struct.pack_into(FRAME_FMT, ring.mem, DATA_OFFSET + offset, head, len(data), 0, t,
+                         frame_chksum(head, len(data), 0, t, data))
+        ring.set_pos(HEAD_OFFSET, head + size) # publish
+        return True
+
+    def close(self):
+        self.ring.close()
+
+
+class RingReader:
+    """Consumer end: the decoder takes all frames available at each wakeup"""
+
+    def __init__(self, path, poll_interval=RING_POLL_INTERVAL):
+        self.path = path
+        self.poll_interval = poll_interval
+        self.ring = None
+
+    # The writer creates the ring: wait for it
+    def attach(self):
+        if self.ring is not None:
+            return True
+        if not os.path.exists(self.path) or os.path.getsize(self.path) <= DATA_OFFSET:
+            return False
+        ring = Ring(self.path)
+        if not ring.valid():
+            ring.close()
+            return False
+        self.ring = ring
+        self.capacity = ring.capacity()
+        return True
+
+    def dropped(self):
+        return self.ring.dropped() if self.ring is not None else 0
+
+    def read(self):
+        """Returns the list of (timestamp, bytes) of frames available now"""
+        if not self.attach():
+            return []
+
+        ring = self.ring
+        head = ring.get_pos(HEAD_OFFSET)
+        tail = ring.get_pos(TAIL_OFFSET)
+        frames = []
+        while tail != head:
+            offset = tail & (self.capacity - 1)
+            pos, length, flags, t, chksum = struct.unpack_from(FRAME_FMT, ring.mem,
+                                                              DATA_OFFSET + offset)
+            if pos != tail:
+                break # contents not yet visible, see above
+            data = b""
+            if not flags & FRAME_FLAG_WRAP:
+                start = DATA_OFFSET + offset + FRAME_HEADER_SIZE
+                data = ring.mem[start:start + length]
+            if frame_chksum(pos, length, flags, t, data) != chksum:
+                break # contents partly visible
+            if flags & FRAME_FLAG_WRAP:
+                tail = (tail + self.capacity - offset) & POS_MASK
+                continue
+            frames.append((t, data))
+            tail = (tail + frame_size(length)) & POS_MASK
+        ring.set_pos(TAIL_OFFSET, tail) # release the space
+        return frames
+
+    def wait(self, timeout=None):
+        """Blocks until at least one frame is available, or until the timeout
+        (sec) expires, and returns the frames as read()"""
+        deadline = None if timeout is None else time.time() + timeout
+        while True:
+            frames = self.read()
+            if len(frames) > 0:
+                return frames
+            if deadline is not None and time.time() >= deadline:
+                return frames
+            time.sleep(self.poll_interval)
+
+    def close(self):
+        if self.ring is not None:
+            self.ring.close()
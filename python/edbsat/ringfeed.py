@@ -0,0 +1,61 @@
+#!/usr/bin/python
+
+import argparse
+import os
+import sys
+import time
+
+from edbsat.ring import *
+
+parser = argparse.ArgumentParser(
+    description="Feed the output of the SDR receiver into the shared memory ring " + \
+                "read by the decoder (edbsat-decode --ring)")
+parser.add_argument('ring',
+    help="Ring file, created if it does not exist (e.g., /dev/shm/edbsat-ring)")
+parser.add_argument('--hex', action='store_true',
+    help="Input is ASCII text with hex numbers separated by whitespace (SpriteReceiver2.py)")
+parser.add_argument('--capacity', type=int, default=RING_DEFAULT_CAPACITY,
+    help="Size (bytes) of the data area of the ring, a power of 2")
+args = parser.parse_args()
+
+READ_SIZE = 4096 # bytes per read from the receiver
+
+writer = RingWriter(args.ring, args.capacity)
+fd = sys.stdin.fileno()
+
+def parse_hex_tokens(tokens):
+    data = []
+    for tok in tokens:
+        try:
+            b = int(tok, 16)
+        except ValueError:
+            b = None
+        if b is None or b > 0xFF:
+            print("invalid hex token:", tok, file=sys.stderr)
+            continue
+        data.append(b)
+    return data
+
+# Each read is one frame, stamped with the time it was read: the receiver
+# writes the bytes of a transmission as it demodulates them
+read_size = min(READ_SIZE, writer.max_frame - FRAME_HEADER_SIZE)
+partial = b"" # hex token split across reads
+while True:
+    chunk = os.read(fd, read_size)
+    t = time.time()
+    if len(chunk) == 0: # receiver exited
+        if len(partial) > 0:
+            writer.write(parse_hex_tokens([partial]), t)
+        break
+
+    if args.hex:
+        tokens = (partial + chunk).split()
+        partial = b""
+        if not chunk[-1:].isspace() and len(tokens) > 0:
+            partial = tokens.pop()
+        data = parse_hex_tokens(tokens)
+    else:
+        data = chunk
+
+    if len(data) > 0 and not writer.write(data, t):
+        print("ring full: dropped %u bytes" % len(data), file=sys.stderr)
@@ -0,0 +1,124 @@
+#!/usr/bin/python
+
+import argparse
+import contextlib
+import io
+import sys
+from collections import Counter
+
+from edbsat.decoder import *
+
+parser = argparse.ArgumentParser(
+    description="Decode ground station bytes from a mission simulation " + \
+                "(bld/sim) and report delivered data")
+parser.add_argument('summary',
+    help="Statistics printed by the simulator")
+parser.add_argument('rx',
+    help="Bytes received on the ground (simulator --rx)")
+parser.add_argument('saved',
+    help="Packets saved to flash (simulator --saved)")
+args = parser.parse_args()
+
+stats = {}
+for line in open(args.summary):
+    k, v = line.split()
+    stats[k] = float(v)
+
+saved = Counter()
+for line in open(args.saved):
+    fields = line.split()
+    pkt_type = int(fields[1])
+    saved[(pkt_type, tuple(int(b, 16) for b in fields[2:]))] += 1
+
+rx = open(args.rx, "rb").read()
+
+with contextlib.redirect_stdout(io.StringIO()), contextlib.redirect_stderr(io.StringIO()):
+    decoded = [(t, tuple(p)) for t, p in decode_all(rx, Decoder(estimates=True))
+                    if t not in [PKT_TYPE_BEACON, PKT_TYPE_BEACON_STATUS]]
+estimates = [p for t, p in decoded if t == PKT_TYPE_PROFILE_ESTIMATE]
+decoded = [pkt for pkt in decoded if pkt[0] != PKT_TYPE_PROFILE_ESTIMATE]
+
+# Energy budget, transition and boot timing pkts travel as energy profile pkts, but are
+# reported apart
+def category(pkt):
+    pkt_type, payload = pkt
+    if pkt_type == PKT_TYPE_APP_OUTPUT:
+        return "app_pkts"
+    kind = parse_pkt_tag(payload)[0]
+    if kind == PKT_KIND_ENERGY_BUDGET:
+        return "budgets"
+    if kind == PKT_KIND_TRANSITIONS:
+        return "transitions"
+    if kind == PKT_KIND_BOOT_TIMING:
+        return "boot_timings"
+    if kind == PKT_KIND_PROFILE_SUM:
+        return "profile_sums"
+    return "profiles"
+
+delivered = Counter()
+false_accepts = 0
+budget_drops = {} # phase: list of Vbank drops (V)
+boot_times = {} # phase: list of durations (s)
+duty_cycles = [] # fraction of the run sampled, per duty-cycled profile
+sum_runs = [] # runs per sum of profiles
+unmatched = Counter(saved)
+for pkt in decoded:
+    if unmatched[pkt] > 0:
+        unmatched[pkt] -= 1
+        delivered[category(pkt)] += 1
+        if category(pkt) == "budgets":
+            kind, flags, payload = parse_pkt_tag(pkt[1])
+            vbank, phases = parse_budget(payload, flags)
+            for phase, v, t in phases:
+                budget_drops.setdefault(phase, []).append(vbank - v)
+                vbank = v
+        if category(pkt) == "profiles":
+            flags, events, edge, duty = parse_profile(list(pkt[1]))
+            if duty is not None:
+                duty_cycles.append(duty / PROFILE_DUTY_ONE)
+        if category(pkt) == "profile_sums":
+            flags, runs, bins = parse_profile_sum(pkt[1])
+            sum_runs.append(runs)
+        if category(pkt) == "boot_timings":
+            kind, flags, payload = parse_pkt_tag(pkt[1])
+            for phase, t in parse_boot_timing(payload):
+                boot_times.setdefault(phase, []).append(t)
+    else:
+        false_accepts += 1
+
+# A progressive profile yields its first estimate with the first byte after
+# the tag, and more with each byte after that
+n_progressive = sum(c for pkt, c in saved.items() if category(pkt) == "profiles" and
+                        parse_pkt_tag(pkt[1][:1])[0] == PKT_KIND_PROFILE_PROGRESSIVE)
+n_estimated = sum(1 for e in estimates if len(e) == 2)
+
+days = stats["sim_days"]
+for name in ["profiles", "app_pkts", "budgets", "transitions", "boot_timings", "profile_sums"]:
+    n_saved = sum(c for pkt, c in saved.items() if category(pkt) == name)
+    if name in ["budgets", "transitions", "boot_timings", "profile_sums"] and n_saved == 0:
+        continue
+    print("%s_delivered %u" % (name, delivered[name]))
+    print("%s_delivered_per_day %.2f" % (name, delivered[name] / days))
+    if n_saved > 0:
+        print("%s_loss_fraction %.3f" % (name, 1 - delivered[name] / n_saved))
+if n_progressive > 0:
+    print("profile_estimates_per_day %.2f" % (len(estimates) / days))
+    print("profiles_estimated_fraction %.3f" % (n_estimated / n_progressive))
+if len(sum_runs) > 0:
+    print("profile_sum_runs_delivered_per_day %.2f" % (sum(sum_runs) / days))
+    print("profile_sum_runs_mean %.2f" % (sum(sum_runs) / len(sum_runs)))
+stopped = sum(stats["profiles_stopped_" + r] for r in ["vcap", "overflow", "timeout"])
+if stopped > 0:
+    print("profiles_overflow_fraction %.3f" % (stats["profiles_stopped_overflow"] / stopped))
+if len(duty_cycles) > 0:
+    print("profile_duty_cycle_mean %.3f" % (sum(duty_cycles) / len(duty_cycles)))
+for phase in BUDGET_PHASES + ["lookup"]:
+    if phase in budget_drops:
+        drops = budget_drops[phase]
+        print("budget_%s_vbank_drop_mV %.1f" % (phase, 1000 * sum(drops) / len(drops)))
+for phase in BOOT_PHASES:
+    if phase in boot_times:
+        times = boot_times[phase]
+        print("boot_%s_ms %.2f" % (phase, 1000 * sum(times) / len(times)))
+print("false_accepts %u" % false_accepts)
+print("flash_erases_per_day %.2f" % (stats["flash_erases"] / days))
@@ -20,6 +20,10 @@ setup(
     entry_points={
         'console_scripts': [
             'edbsat-decode=edbsat.decode',
+            'edbsat-ring-feed=edbsat.ringfeed',
+            'edbsat-query=edbsat.query',
+            'edbsat-sim-report=edbsat.simreport',
+            'edbsat-chanbench=edbsat.chanbench',
         ],
     },
 )
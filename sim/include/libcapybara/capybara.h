@@ -0,0 +1,12 @@
+#ifndef SIM_LIBCAPYBARA_CAPYBARA_H
+#define SIM_LIBCAPYBARA_CAPYBARA_H
+
+#define LIBCAPYBARA_PORT_VBOOST_OK 2
+#define LIBCAPYBARA_PIN_VBOOST_OK  0
+
+void capybara_config_pins(void);
+void capybara_wait_for_supply(void);
+void capybara_shutdown(void) __attribute__((noreturn));
+void capybara_vboost_ok_isr(void);
+
+#endif // SIM_LIBCAPYBARA_CAPYBARA_H
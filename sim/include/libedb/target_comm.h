@@ -0,0 +1,4 @@
+#ifndef SIM_LIBEDB_TARGET_COMM_H
+#define SIM_LIBEDB_TARGET_COMM_H
+
+#endif // SIM_LIBEDB_TARGET_COMM_H
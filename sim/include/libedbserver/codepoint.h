@@ -0,0 +1,10 @@
+#ifndef SIM_LIBEDBSERVER_CODEPOINT_H
+#define SIM_LIBEDBSERVER_CODEPOINT_H
+
+#include <stdbool.h>
+
+void toggle_watchpoint(unsigned index, bool enable, bool vcap_snapshot);
+void enable_watchpoints(void);
+void disable_watchpoints(void);
+
+#endif // SIM_LIBEDBSERVER_CODEPOINT_H
@@ -0,0 +1,12 @@
+#ifndef SIM_LIBEDBSERVER_EDB_H
+#define SIM_LIBEDBSERVER_EDB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef bool (*watchpoint_callback_t)(unsigned index, uint16_t vcap);
+
+void edb_server_init(void);
+void edb_set_watchpoint_callback(watchpoint_callback_t cb);
+
+#endif // SIM_LIBEDBSERVER_EDB_H
@@ -0,0 +1,4 @@
+#ifndef SIM_LIBEDBSERVER_HOST_COMM_IMPL_H
+#define SIM_LIBEDBSERVER_HOST_COMM_IMPL_H
+
+#endif // SIM_LIBEDBSERVER_HOST_COMM_IMPL_H
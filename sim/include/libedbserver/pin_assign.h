@@ -0,0 +1,4 @@
+#ifndef SIM_LIBEDBSERVER_PIN_ASSIGN_H
+#define SIM_LIBEDBSERVER_PIN_ASSIGN_H
+
+#endif // SIM_LIBEDBSERVER_PIN_ASSIGN_H
@@ -0,0 +1,4 @@
+#ifndef SIM_LIBEDBSERVER_UART_H
+#define SIM_LIBEDBSERVER_UART_H
+
+#endif // SIM_LIBEDBSERVER_UART_H
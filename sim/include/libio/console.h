@@ -0,0 +1,14 @@
+#ifndef SIM_LIBIO_CONSOLE_H
+#define SIM_LIBIO_CONSOLE_H
+
+// Output costs simulated time at the console baudrate
+void sim_log(const char *fmt, ...);
+
+#define INIT_CONSOLE()
+#ifdef SIM_NO_CONSOLE
+#define LOG(...)
+#else // !SIM_NO_CONSOLE
+#define LOG(...) sim_log(__VA_ARGS__)
+#endif // !SIM_NO_CONSOLE
+
+#endif // SIM_LIBIO_CONSOLE_H
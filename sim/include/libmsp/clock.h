@@ -0,0 +1,6 @@
+#ifndef SIM_LIBMSP_CLOCK_H
+#define SIM_LIBMSP_CLOCK_H
+
+void msp_clock_setup(void);
+
+#endif // SIM_LIBMSP_CLOCK_H
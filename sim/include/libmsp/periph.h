@@ -0,0 +1,46 @@
+#ifndef SIM_LIBMSP_PERIPH_H
+#define SIM_LIBMSP_PERIPH_H
+
+#include <msp430.h>
+
+#define BIT(n) (1 << (n))
+
+#define GPIO_(port, reg) P ## port ## reg
+#define GPIO(port, reg) GPIO_(port, reg)
+
+#define INTVEC_(port) P ## port ## IV
+#define INTVEC(port) INTVEC_(port)
+#define INTVEC_RANGE(port) 0x10
+#define INTFLAG(port, pin) (((pin) + 1) << 1)
+
+#define GPIO_VECTOR(port) 0
+#define GPIO_ISR_(port) PORT_ ## port ## _ISR
+#define GPIO_ISR(port) GPIO_ISR_(port)
+
+// Comparator: one instance, the type argument is ignored
+#define COMP(type, reg) COMP_ ## reg
+#define COMP2(type, reg, n) COMP2_ ## reg(n)
+#define COMP_VECTOR(type) 0
+
+extern volatile uint16_t COMP_CTL0, COMP_CTL1, COMP_CTL2, COMP_CTL3, COMP_INT, COMP_IV;
+
+#define COMP_IMEN    0x8000
+#define COMP_RS_1    0x0040
+#define COMP_PWRMD_2 0x0200
+#define COMP_ON      0x0400
+#define COMP_OUT     0x0001
+#define COMP_IFG     0x0001
+#define COMP_IIFG    0x0002
+#define COMP_IE      0x0100
+#define COMP_IV_IFG  0x0002
+#define COMP_IV_IIFG 0x0004
+
+#define COMP2_PD(n)     (1 << (n))
+#define COMP2_IMSEL_(n) ((n) << 8)
+#define COMP2_REF0_(n)  (n)
+#define COMP2_REF1_(n)  ((n) << 8)
+
+#define COMP_REF0_MASK 0x001F
+#define COMP_REF1_MASK 0x1F00
+
+#endif // SIM_LIBMSP_PERIPH_H
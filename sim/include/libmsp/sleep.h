@@ -0,0 +1,14 @@
+#ifndef SIM_LIBMSP_SLEEP_H
+#define SIM_LIBMSP_SLEEP_H
+
+typedef enum {
+    MSP_ALARM_ACTION_CONTINUE = 0,
+    MSP_ALARM_ACTION_WAKEUP,
+} msp_alarm_action_t;
+
+typedef msp_alarm_action_t (*msp_alarm_cb_t)(void);
+
+void msp_sleep(unsigned ticks);
+void msp_alarm(unsigned ticks, msp_alarm_cb_t cb);
+
+#endif // SIM_LIBMSP_SLEEP_H
@@ -0,0 +1,12 @@
+#ifndef SIM_LIBMSP_WATCHDOG_H
+#define SIM_LIBMSP_WATCHDOG_H
+
+// Interval is set from the simulator command line instead
+#define WATCHDOG_BITS(clk, interval) 0
+
+void msp_watchdog_enable(unsigned bits);
+void msp_watchdog_disable(void);
+void msp_watchdog_hold(void);
+void msp_watchdog_release(void);
+
+#endif // SIM_LIBMSP_WATCHDOG_H
@@ -0,0 +1,10 @@
+#ifndef SIM_LIBMSPUARTLINK_UARTLINK_H
+#define SIM_LIBMSPUARTLINK_UARTLINK_H
+
+#include <stdint.h>
+
+void uartlink_open_rx(void);
+void uartlink_close(void);
+unsigned uartlink_receive(uint8_t *payload);
+
+#endif // SIM_LIBMSPUARTLINK_UARTLINK_H
@@ -0,0 +1,9 @@
+#ifndef SIM_LIBSPRITE_SPRITERADIO_H
+#define SIM_LIBSPRITE_SPRITERADIO_H
+
+void SpriteRadio_SpriteRadio(void);
+void SpriteRadio_txInit(void);
+void SpriteRadio_transmit(char bytes[], unsigned length);
+void SpriteRadio_sleep(void);
+
+#endif // SIM_LIBSPRITE_SPRITERADIO_H
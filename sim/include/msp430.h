@@ -0,0 +1,164 @@
+#ifndef SIM_MSP430_H
+#define SIM_MSP430_H
+
+// Host stand-in for the MSP430 device header: peripherals that the firmware
+// touches are plain variables, or accessors into the simulator (sim/src/hw.c)
+// where a register access has side effects.
+
+#include <stdint.h>
+
+// Interrupt handlers are plain functions that the simulator calls
+#define interrupt(vector) unused
+
+#define BIT0 0x0001
+#define BIT1 0x0002
+#define BIT2 0x0004
+#define BIT3 0x0008
+#define BIT4 0x0010
+#define BIT5 0x0020
+#define BIT6 0x0040
+#define BIT7 0x0080
+
+#define LPM0_bits 0x0010
+#define LPM4_bits 0x00F0
+
+void sim_lpm(unsigned bits);
+void sim_wakeup(void);
+void sim_delay_cycles(unsigned long cycles);
+
+#define __bis_SR_register(bits)         sim_lpm(bits)
+#define __bic_SR_register_on_exit(bits) sim_wakeup()
+#define __delay_cycles(n)               sim_delay_cycles(n)
+#define __enable_interrupt()
+#define __disable_interrupt()
+#define __even_in_range(v, range)       (v)
+
+// GPIO
+#define SIM_GPIO_PORT(p) \
+    extern volatile uint8_t P##p##IN, P##p##OUT, P##p##DIR, P##p##SEL, \
+                            P##p##IE, P##p##IES, P##p##IFG; \
+    extern volatile uint16_t P##p##IV;
+SIM_GPIO_PORT(1)
+SIM_GPIO_PORT(2)
+SIM_GPIO_PORT(3)
+SIM_GPIO_PORT(4)
+SIM_GPIO_PORT(J)
+#undef SIM_GPIO_PORT
+
+extern volatile uint8_t P2MAP4;
+
+// Unified clock system: only the MCLK divider is modeled
+extern volatile uint16_t UCSCTL5;
+#define DIVM_7  0x0007
+#define DIVM__1 0x0000
+#define DIVM__2 0x0001
+#define DIVM__4 0x0002
+#define DIVM__8 0x0003
+#define DIVM__16 0x0004
+#define DIVM__32 0x0005
+
+// Power management module: changes of core voltage complete immediately
+extern volatile uint16_t PMMCTL0, SVSMHCTL, SVSMLCTL;
+#define PMMCTL0_L (((volatile uint8_t *)&PMMCTL0)[0])
+#define PMMCTL0_H (((volatile uint8_t *)&PMMCTL0)[1])
+#define PMMPW_H     0xA5
+#define PMMCOREV0   0x0001
+#define PMMCOREV_3  0x0003
+#define SVSMHRRL0   0x0001
+#define SVSHRVL0    0x0100
+#define SVSHE       0x0400
+#define SVMHE       0x4000
+#define SVSMLRRL0   0x0001
+#define SVSLRVL0    0x0100
+#define SVSLE       0x0400
+#define SVMLE       0x4000
+#define SVSMLDLYIFG 0x0001
+#define SVMLIFG     0x0002
+#define SVMLVLRIFG  0x0004
+volatile uint16_t *sim_pmmifg(void);
+#define PMMIFG (*sim_pmmifg())
+
+// Flash controller
+#define FWPW    0xA500
+#define ERASE   0x0002
+#define WRT     0x0040
+#define BLKWRT  0x0080
+#define BUSY    0x0001
+#define ACCVIFG 0x0004
+#define LOCK    0x0010
+#define LOCKA   0x0040 // not modeled: reads as clear
+
+volatile uint16_t *sim_fctl1(void);
+volatile uint16_t *sim_fctl3(void);
+#define FCTL1 (*sim_fctl1())
+#define FCTL3 (*sim_fctl3())
+
+// Information memory in (simulated) flash, persists across boots. The build
+// maps the flash segment addresses in the configuration into this buffer.
+#define SIM_INFO_MEM_ADDR 0x1800
+#define SIM_INFO_MEM_SIZE 0x200
+#define SIM_INFO_MEM_SEGMENT_SIZE 128
+extern uint8_t *sim_info_mem;
+#define SIM_INFO_SEGMENT(addr) (sim_info_mem + ((addr) - SIM_INFO_MEM_ADDR))
+
+// CRC16 module
+volatile uint16_t *sim_crc_inires(void);
+volatile uint16_t *sim_crc_di(void);
+volatile uint8_t *sim_crc_di_l(void);
+#define CRCINIRES (*sim_crc_inires())
+#define CRCDI     (*sim_crc_di())
+#define CRCDI_L   (*sim_crc_di_l())
+
+// Timer_B0 and Timer_A2: count ACLK while in continuous mode, only the
+// input dividers are modeled, and the compare interrupt of Timer_B0 CCR1.
+// The wrap interrupt of Timer_A2 never fires: boots are shorter than a wrap.
+extern volatile uint16_t TB0CTL, TB0EX0, TB0CCTL1, TB0CCR1, TB0IV;
+uint16_t sim_tb0r(void);
+#define TB0R sim_tb0r()
+
+extern volatile uint16_t TA2CTL, TA2EX0, TA2IV;
+uint16_t sim_ta2r(void);
+#define TA2R sim_ta2r()
+
+#define TBSSEL_1 0x0100
+#define TASSEL_1 0x0100
+#define ID_2     0x0080
+#define ID_3     0x00C0
+#define MC_2     0x0020
+#define MC_3     0x0030
+#define TBCLR    0x0004
+#define TACLR    0x0004
+#define TBIDEX_7 0x0007
+#define CCIE     0x0010
+#define TAIE     0x0002
+#define TAIFG    0x0001
+
+#define TB0IV_TBCCR1 0x0002
+#define TB0IV_TBIFG  0x000E
+#define TA2IV_TAIFG  0x000E
+
+// ADC12 and reference
+extern volatile uint16_t ADC12CTL0, ADC12CTL1, REFCTL0;
+extern volatile uint8_t ADC12MCTL0;
+uint16_t sim_adc_conversion(void);
+#define ADC12MEM0 sim_adc_conversion()
+
+#define ADC12ON       0x0010
+#define ADC12ENC      0x0002
+#define ADC12SC       0x0001
+#define ADC12SHT0_0   0x0000
+#define ADC12SHT0_15  0x0F00
+#define ADC12SHT1_0   0x0000
+#define ADC12SHT1_15  0xF000
+#define ADC12SHP      0x0200
+#define ADC12CONSEQ_3 0x0006
+#define ADC12BUSY     0x0001
+#define ADC12SREF_0   0x00
+#define ADC12SREF_1   0x10
+#define ADC12EOS      0x80
+
+#define REFMSTR  0x0080
+#define REFTCOFF 0x0008
+#define REFON    0x0001
+
+#endif // SIM_MSP430_H
@@ -0,0 +1,67 @@
+// Host benchmark of the watchpoint callback (profile_event() in
+// src/profile.c): time per call, on runs of events that never overflow a
+// counter, and time to pack the counters into the profile at the end of a
+// run. The host CPU is not the MCU, so the numbers are for comparing builds
+// with each other, not for the ISR time of the energy model.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "profile.h"
+
+// Events in a run: round robin over the watchpoints, alternating between
+// the bins, and few enough for all events of a watchpoint to fit in one bin
+#define BENCH_RUN_EVENTS (NUM_EVENTS * PROFILE_EHIST_BIN_MASK)
+#define BENCH_VCAP_LOW   0
+#define BENCH_VCAP_HIGH  0x0FFF // ADC max
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Counters are zeroed as by start_profiling()
+static void reset_profile()
+{
+    memset(&profile, 0, sizeof(profile_t));
+    profile_unpack();
+}
+
+void sim_bench_profile(unsigned long events)
+{
+    unsigned idx[BENCH_RUN_EVENTS];
+    uint16_t vcap[BENCH_RUN_EVENTS];
+    for (unsigned i = 0; i < BENCH_RUN_EVENTS; ++i) {
+        idx[i] = i % NUM_EVENTS;
+        vcap[i] = (i / NUM_EVENTS) & 0x1 ? BENCH_VCAP_HIGH : BENCH_VCAP_LOW;
+    }
+    unsigned long runs = (events + BENCH_RUN_EVENTS - 1) / BENCH_RUN_EVENTS;
+
+    double t = now();
+    for (unsigned long r = 0; r < runs; ++r)
+        reset_profile();
+    double t_reset = now() - t;
+
+    unsigned overflows = 0;
+    t = now();
+    for (unsigned long r = 0; r < runs; ++r) {
+        reset_profile();
+        for (unsigned i = 0; i < BENCH_RUN_EVENTS; ++i)
+            overflows += profile_event(idx[i], vcap[i]);
+    }
+    double t_events = now() - t - t_reset;
+
+    t = now();
+    for (unsigned long r = 0; r < runs; ++r)
+        profile_pack();
+    double t_pack = now() - t;
+
+    printf("bench_profile_events %lu\n", runs * BENCH_RUN_EVENTS);
+    printf("bench_profile_overflows %u\n", overflows);
+    printf("bench_profile_event_ns %.2f\n", t_events * 1e9 / (runs * BENCH_RUN_EVENTS));
+    printf("bench_profile_pack_ns %.2f\n", t_pack * 1e9 / runs);
+}
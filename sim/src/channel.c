@@ -0,0 +1,36 @@
+#include <unistd.h>
+
+#include "sim.h"
+#include "channel.h"
+
+void channel_transmit(const uint8_t *bytes, unsigned len)
+{
+    if (rng_uniform() >= sim_cfg.visibility)
+        return; // ground station not listening or out of view
+
+    uint8_t rx[len + 1];
+    unsigned rx_len = 0;
+
+    for (unsigned i = 0; i < len; ++i) {
+        if (rng_uniform() < sim_cfg.drop) {
+            ++sim->bytes_dropped;
+            continue;
+        }
+
+        uint8_t b = bytes[i];
+        for (unsigned j = 0; j < 8; ++j) {
+            if (rng_uniform() < sim_cfg.ber) {
+                b ^= 1 << j;
+                ++sim->bit_errors;
+            }
+        }
+        rx[rx_len++] = b;
+    }
+
+    if (rng_uniform() < sim_cfg.noise)
+        rx[rx_len++] = (uint8_t)(rng_uniform() * 256);
+
+    sim->bytes_heard += rx_len;
+    if (sim_rx_fd >= 0 && rx_len > 0)
+        write(sim_rx_fd, rx, rx_len);
+}
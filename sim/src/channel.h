@@ -0,0 +1,9 @@
+#ifndef SIM_CHANNEL_H
+#define SIM_CHANNEL_H
+
+#include <stdint.h>
+
+// Deliver a transmission to the ground station over the lossy channel
+void channel_transmit(const uint8_t *bytes, unsigned len);
+
+#endif // SIM_CHANNEL_H
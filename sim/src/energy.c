@@ -0,0 +1,72 @@
+#include <math.h>
+#include <string.h>
+
+#include "sim.h"
+#include "energy.h"
+
+static bool in_sunlight(double t)
+{
+    return fmod(t, sim_cfg.orbit_period) < sim_cfg.orbit_period - sim_cfg.eclipse;
+}
+
+static double const_power(double t)
+{
+    return sim_cfg.p_harvest;
+}
+
+static double orbit_power(double t)
+{
+    return in_sunlight(t) ? sim_cfg.p_harvest : 0.0;
+}
+
+// Panel of a tumbling spacecraft sees the sun at a varying angle
+static double tumble_power(double t)
+{
+    if (!in_sunlight(t))
+        return 0.0;
+    return sim_cfg.p_harvest * fabs(cos(2 * M_PI * t / sim_cfg.tumble_period));
+}
+
+static const harvester_t harvesters[] = {
+    { "const",  "constant power",                           const_power },
+    { "orbit",  "constant power in sunlight, none in eclipse", orbit_power },
+    { "tumble", "orbit, scaled by sun angle of a tumbling panel", tumble_power },
+};
+
+const harvester_t *harvester_find(const char *name)
+{
+    for (unsigned i = 0; i < sizeof(harvesters) / sizeof(harvesters[0]); ++i)
+        if (!strcmp(harvesters[i].name, name))
+            return &harvesters[i];
+    return NULL;
+}
+
+void harvester_list(FILE *f)
+{
+    for (unsigned i = 0; i < sizeof(harvesters) / sizeof(harvesters[0]); ++i)
+        fprintf(f, "  %-8s %s\n", harvesters[i].name, harvesters[i].help);
+}
+
+// Ideal capacitor with a constant leakage current
+void energy_step(double dt, double p_load, bool harvesting)
+{
+    double c = sim_cfg.capacitance;
+    double v = sim->vbank;
+    double e = 0.5 * c * v * v;
+
+    double p_in = harvesting ? sim_cfg.harvester->power(sim->t) * sim_cfg.eta_in : 0.0;
+    double p_out = p_load / sim_cfg.eta_out + v * sim_cfg.leakage;
+
+    e += (p_in - p_out) * dt;
+    if (e < 0.0)
+        e = 0.0;
+
+    v = sqrt(2 * e / c);
+    if (v > sim_cfg.v_max)
+        v = sim_cfg.v_max;
+
+    sim->vbank = v;
+    sim->t += dt;
+    sim->energy_harvested += p_in * dt;
+    sim->energy_used += p_load * dt;
+}
@@ -0,0 +1,21 @@
+#ifndef SIM_ENERGY_H
+#define SIM_ENERGY_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Harvested power as a function of time
+typedef struct {
+    const char *name;
+    const char *help;
+    double (*power)(double t); // W
+} harvester_t;
+
+const harvester_t *harvester_find(const char *name);
+void harvester_list(FILE *f);
+
+// Advance time by dt while drawing p_load (W) from the supercap bank, and
+// harvesting into the bank if the harvester is connected
+void energy_step(double dt, double p_load, bool harvesting);
+
+#endif // SIM_ENERGY_H
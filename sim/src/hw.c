@@ -0,0 +1,641 @@
+// Simulated peripherals and libraries that the firmware runs against.
+//
+// Runs in the child process of a single boot: state in this file starts
+// fresh on each boot (like RAM after reset), state in 'sim' persists.
+
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <msp430.h>
+#include <libmsp/periph.h>
+#include <libmsp/clock.h>
+#include <libmsp/sleep.h>
+#include <libmsp/watchdog.h>
+#include <libcapybara/capybara.h>
+#include <libio/console.h>
+#include <libmspuartlink/uartlink.h>
+#include <libsprite/SpriteRadio.h>
+#include <libedbserver/edb.h>
+#include <libedbserver/codepoint.h>
+
+#include "sim.h"
+#include "channel.h"
+#include "payload.h"
+
+// Max time step for energy and comparator updates
+#define MAX_STEP 0.01 // s
+
+// Defined in the firmware (src/profile.c)
+void COMP_VBANK_ISR(void);
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+void TIMER0_B1_ISR(void);
+#endif // CONFIG_PROFILE_DUTY_CYCLE
+
+#define SIM_GPIO_PORT(p) \
+    volatile uint8_t P##p##IN, P##p##OUT, P##p##DIR, P##p##SEL, \
+                     P##p##IE, P##p##IES, P##p##IFG; \
+    volatile uint16_t P##p##IV;
+SIM_GPIO_PORT(1)
+SIM_GPIO_PORT(2)
+SIM_GPIO_PORT(3)
+SIM_GPIO_PORT(4)
+SIM_GPIO_PORT(J)
+#undef SIM_GPIO_PORT
+
+volatile uint8_t P2MAP4;
+volatile uint16_t ADC12CTL0, ADC12CTL1, REFCTL0;
+volatile uint8_t ADC12MCTL0;
+volatile uint16_t COMP_CTL0, COMP_CTL1, COMP_CTL2, COMP_CTL3, COMP_INT, COMP_IV;
+
+volatile uint16_t UCSCTL5;
+volatile uint16_t PMMCTL0, SVSMHCTL, SVSMLCTL;
+
+uint8_t *sim_info_mem;
+
+static bool woken;
+
+static bool watchdog_on;
+static double boot_start;
+
+static double alarm_time = INFINITY;
+static msp_alarm_cb_t alarm_cb;
+
+static watchpoint_callback_t watchpoint_cb;
+static bool watchpoints_on;
+static bool watchpoint_enabled[WORKLOAD_MAX_WATCHPOINTS];
+static bool watchpoint_vcap[WORKLOAD_MAX_WATCHPOINTS];
+static double watchpoint_next[WORKLOAD_MAX_WATCHPOINTS];
+static bool app_was_powered;
+
+static bool uartlink_rx_open;
+static double app_data_time = INFINITY;
+static bool app_data_arrived;
+
+static bool comp_out;
+
+static bool tb0_compare_on;
+static unsigned long tb0_checked; // Timer_B0 count when last checked for a match
+
+// MCLK is divided by the firmware (dvfs.c) and SIM_MCLK_FREQ is the undivided
+// frequency. The active power above the LPM floor scales with MCLK.
+static unsigned mclk_div()
+{
+    return 1 << (UCSCTL5 & DIVM_7);
+}
+
+static double p_cpu()
+{
+    return sim_cfg.p_lpm + (sim_cfg.p_active - sim_cfg.p_lpm) / mclk_div();
+}
+
+static bool app_powered()
+{
+    return GPIO(PORT_APP_SW, OUT) & BIT(PIN_APP_SW);
+}
+
+static bool harvester_connected()
+{
+    return !(GPIO(PORT_ISOL_EN, OUT) & BIT(PIN_ISOL_EN));
+}
+
+static uint16_t adc_sample(double v, double vref)
+{
+    double sample = v / vref * 4096 + sim_cfg.adc_noise * rng_normal();
+    if (sample < 0)
+        sample = 0;
+    if (sample > 4095)
+        sample = 4095;
+    return (uint16_t)sample;
+}
+
+// Comparator: Vbank (divided) on V-, resistor ladder tap on V+, so output
+// is high when Vbank is below threshold. Taps give hysteresis: REF0 applies
+// while output is low, REF1 while it is high.
+static void update_comparator()
+{
+    if (!(COMP_CTL1 & COMP_ON))
+        return;
+
+    unsigned tap = comp_out ? (COMP_CTL2 & COMP_REF1_MASK) >> 8 : COMP_CTL2 & COMP_REF0_MASK;
+    double v_tap = (tap + 1) * SIM_VDD_EDB / SIM_COMP_TAPS;
+    bool out = sim->vbank * SIM_VBANK_DIV < v_tap;
+
+    if (out)
+        COMP_CTL1 |= COMP_OUT;
+    else
+        COMP_CTL1 &= ~COMP_OUT;
+
+    if (out && !comp_out) { // rising edge
+        COMP_INT |= COMP_IFG;
+        if (COMP_INT & COMP_IE) {
+            COMP_IV = COMP_IV_IFG;
+            COMP_VBANK_ISR();
+        }
+    }
+    comp_out = out;
+}
+
+// Run for dt at given power: everything else in the system advances with time
+static void power_step(double dt, double p)
+{
+    if (app_powered())
+        p += sim_cfg.p_app;
+
+    energy_step(dt, p, harvester_connected());
+
+    if (sim->vbank <= sim_cfg.v_off)
+        sim_exit(SIM_EXIT_BROWNOUT);
+    if (watchdog_on && sim_cfg.watchdog > 0 && sim->t - boot_start > sim_cfg.watchdog)
+        sim_exit(SIM_EXIT_WATCHDOG);
+
+    update_comparator();
+}
+
+static void update_watchpoints()
+{
+    bool powered = app_powered();
+    for (unsigned i = 0; i < NUM_EVENTS; ++i) {
+        if (powered && (!app_was_powered || isinf(watchpoint_next[i])))
+            watchpoint_next[i] = sim_cfg.workload->next_event(i, sim->t, !app_was_powered);
+        else if (!powered)
+            watchpoint_next[i] = INFINITY;
+    }
+    app_was_powered = powered;
+}
+
+static double timer_freq(uint16_t ctl, uint16_t ex0)
+{
+    return (double)SIM_ACLK_FREQ / ((1 << ((ctl & ID_3) >> 6)) * ((ex0 & TBIDEX_7) + 1));
+}
+
+static unsigned long tb0_ticks()
+{
+    // not short of a match because of rounding
+    return (unsigned long)floor(sim->t * timer_freq(TB0CTL, TB0EX0) + 1e-6);
+}
+
+// Time when the Timer_B0 count next reaches CCR1, after the last check
+static double tb0_next_compare()
+{
+    if (!(TB0CTL & MC_3) || !(TB0CCTL1 & CCIE)) {
+        tb0_compare_on = false;
+        return INFINITY;
+    }
+    if (!tb0_compare_on) { // just enabled
+        tb0_compare_on = true;
+        tb0_checked = tb0_ticks();
+    }
+    unsigned delta = (uint16_t)(TB0CCR1 - (uint16_t)tb0_checked);
+    if (delta == 0)
+        delta = 0x10000;
+    return (tb0_checked + delta) / timer_freq(TB0CTL, TB0EX0);
+}
+
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+// Whether the count reached CCR1 since the last check: an ISR that ran
+// across the time of the match delays the interrupt, but does not lose it
+static bool tb0_compare_due()
+{
+    if (!tb0_compare_on || !(TB0CCTL1 & CCIE))
+        return false;
+    unsigned long now = tb0_ticks();
+    bool due = (uint16_t)(TB0CCR1 - tb0_checked - 1) < now - tb0_checked;
+    tb0_checked = now;
+    return due;
+}
+#endif // CONFIG_PROFILE_DUTY_CYCLE
+
+static double next_interrupt()
+{
+    double t = alarm_time;
+
+    double t_compare = tb0_next_compare();
+    if (t_compare < t)
+        t = t_compare;
+
+    update_watchpoints();
+    for (unsigned i = 0; i < NUM_EVENTS; ++i)
+        if (watchpoint_next[i] < t)
+            t = watchpoint_next[i];
+
+    if (uartlink_rx_open && !app_data_arrived && app_data_time < t)
+        t = app_data_time;
+
+    return t;
+}
+
+static void service_interrupts()
+{
+    if (sim->t >= alarm_time) {
+        alarm_time = INFINITY;
+        if (alarm_cb() == MSP_ALARM_ACTION_WAKEUP)
+            woken = true;
+    }
+
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+    if (tb0_compare_due()) {
+        TB0IV = TB0IV_TBCCR1;
+        TIMER0_B1_ISR();
+        power_step(sim_cfg.isr_time * mclk_div(), p_cpu());
+    }
+#endif // CONFIG_PROFILE_DUTY_CYCLE
+
+    for (unsigned i = 0; i < NUM_EVENTS; ++i) {
+        if (sim->t < watchpoint_next[i])
+            continue;
+
+        // The app keeps running, even if EDB ignores the watchpoint
+        watchpoint_next[i] = sim_cfg.workload->next_event(i, sim->t, false);
+
+        if (!watchpoints_on || !watchpoint_enabled[i] || !watchpoint_cb)
+            continue;
+
+        ++sim->watchpoint_events;
+        uint16_t vcap = watchpoint_vcap[i] ?
+            adc_sample(sim->vbank * SIM_VDD_AP_DIV, SIM_VDD_AP_REF) : 0;
+        if (watchpoint_cb(i, vcap))
+            woken = true;
+        double isr_time = sim_cfg.isr_time * mclk_div();
+        if (watchpoint_vcap[i])
+            isr_time += sim_cfg.snapshot_time; // ADC clock is not divided with MCLK
+        power_step(isr_time, p_cpu());
+    }
+
+    if (uartlink_rx_open && !app_data_arrived && sim->t >= app_data_time) {
+        app_data_arrived = true;
+        woken = true;
+    }
+}
+
+// Execute for dt seconds at given power, while servicing interrupts
+static void run(double dt, double p)
+{
+    double end = sim->t + dt;
+    while (sim->t < end) {
+        double step = end - sim->t;
+        if (step > MAX_STEP)
+            step = MAX_STEP;
+
+        double t_int = next_interrupt();
+        if (t_int < sim->t + step)
+            step = t_int > sim->t ? t_int - sim->t : 0;
+
+        power_step(step, p);
+        service_interrupts();
+    }
+}
+
+void sim_lpm(unsigned bits)
+{
+    woken = false;
+    while (!woken)
+        run(MAX_STEP, sim_cfg.p_lpm);
+}
+
+void sim_wakeup(void)
+{
+    woken = true;
+}
+
+void sim_delay_cycles(unsigned long cycles)
+{
+    run((double)cycles * mclk_div() / SIM_MCLK_FREQ, p_cpu());
+}
+
+void sim_log(const char *fmt, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    if (sim_cfg.verbose)
+        fputs(buf, stderr);
+
+    // Console output is blocking, 10 bits per char
+    run(len * 10.0 / SIM_CONSOLE_BAUDRATE, p_cpu());
+}
+
+// Flash controller: every operation in the firmware is bracketed by
+// accesses to FCTL3, so that is where the effect of an operation is applied.
+// Programming can only clear bits. Info memory is kept read-only between
+// operations, so that the address of the (dummy) write that triggers an
+// erase is caught by the fault handler.
+
+static volatile uint16_t fctl1, fctl3;
+static bool erase_pending;
+static uint8_t * volatile flash_write_addr;
+static uint8_t flash_before[SIM_INFO_MEM_SIZE];
+
+static void flash_fault(int sig, siginfo_t *info, void *ctx)
+{
+    uint8_t *addr = info->si_addr;
+    if (addr < sim_info_mem || addr >= sim_info_mem + SIM_INFO_MEM_SIZE) {
+        signal(SIGSEGV, SIG_DFL);
+        return; // a genuine fault: re-raised when the instruction restarts
+    }
+    flash_write_addr = addr;
+    mprotect(sim_info_mem, SIM_INFO_MEM_SIZE, PROT_READ | PROT_WRITE);
+}
+
+static void flash_protect()
+{
+    memcpy(flash_before, sim_info_mem, SIM_INFO_MEM_SIZE);
+    flash_write_addr = NULL;
+    mprotect(sim_info_mem, SIM_INFO_MEM_SIZE, PROT_READ);
+}
+
+volatile uint16_t *sim_fctl1(void)
+{
+    erase_pending = true;
+    return &fctl1;
+}
+
+volatile uint16_t *sim_fctl3(void)
+{
+    if (!flash_write_addr) {
+        // nothing written
+    } else if ((fctl1 & ERASE) && erase_pending) {
+        erase_pending = false;
+        unsigned offset = (flash_write_addr - sim_info_mem) & ~(SIM_INFO_MEM_SEGMENT_SIZE - 1);
+        memset(sim_info_mem + offset, 0xff, SIM_INFO_MEM_SEGMENT_SIZE);
+        ++sim->flash_erases;
+        power_step(sim_cfg.flash_erase_time, sim_cfg.p_flash);
+    } else {
+        unsigned written = 0;
+        for (unsigned i = 0; i < SIM_INFO_MEM_SIZE; ++i) {
+            if (sim_info_mem[i] != flash_before[i]) {
+                sim_info_mem[i] &= flash_before[i];
+                ++written;
+            }
+        }
+        if (written) {
+            sim->flash_bytes_written += written;
+            power_step((written + 1) / 2 * sim_cfg.flash_word_time, sim_cfg.p_flash);
+        }
+    }
+    flash_protect();
+    return &fctl3;
+}
+
+static volatile uint16_t pmmifg;
+
+volatile uint16_t *sim_pmmifg(void)
+{
+    pmmifg |= SVSMLDLYIFG | SVMLVLRIFG;
+    return &pmmifg;
+}
+
+// CRC16-CCITT module: input bits are processed LSB-first. Data written
+// to an input register is applied on the next access to the module.
+
+static volatile uint16_t crc_res;
+static volatile uint16_t crc_di;
+static volatile uint8_t crc_di_l;
+static enum { CRC_IN_NONE, CRC_IN_WORD, CRC_IN_BYTE } crc_in = CRC_IN_NONE;
+
+static void crc_byte(uint8_t b)
+{
+    for (unsigned i = 0; i < 8; ++i) {
+        unsigned fb = ((crc_res >> 15) & 0x1) ^ ((b >> i) & 0x1);
+        crc_res <<= 1;
+        if (fb)
+            crc_res ^= 0x1021;
+    }
+}
+
+static void crc_apply()
+{
+    switch (crc_in) {
+        case CRC_IN_WORD:
+            crc_byte(crc_di & 0xff);
+            crc_byte(crc_di >> 8);
+            break;
+        case CRC_IN_BYTE:
+            crc_byte(crc_di_l);
+            break;
+        default:
+            break;
+    }
+    crc_in = CRC_IN_NONE;
+}
+
+volatile uint16_t *sim_crc_inires(void)
+{
+    crc_apply();
+    return &crc_res;
+}
+
+volatile uint16_t *sim_crc_di(void)
+{
+    crc_apply();
+    crc_in = CRC_IN_WORD;
+    return &crc_di;
+}
+
+volatile uint8_t *sim_crc_di_l(void)
+{
+    crc_apply();
+    crc_in = CRC_IN_BYTE;
+    return &crc_di_l;
+}
+
+// ADC: only the divided Vbank channel is connected
+uint16_t sim_adc_conversion(void)
+{
+    double vref = (ADC12MCTL0 & ADC12SREF_1) ? 1.5 : SIM_VDD_EDB;
+    return adc_sample(sim->vbank * SIM_VBANK_DIV, vref);
+}
+
+static uint16_t timer_count(uint16_t ctl, uint16_t ex0)
+{
+    if (!(ctl & MC_3))
+        return 0;
+    return (uint16_t)(unsigned long)(sim->t * timer_freq(ctl, ex0));
+}
+
+volatile uint16_t TB0CTL, TB0EX0, TB0CCTL1, TB0CCR1, TB0IV;
+
+uint16_t sim_tb0r(void)
+{
+    return timer_count(TB0CTL, TB0EX0);
+}
+
+volatile uint16_t TA2CTL, TA2EX0, TA2IV;
+
+uint16_t sim_ta2r(void)
+{
+    return timer_count(TA2CTL, TA2EX0);
+}
+
+// libmsp
+
+void msp_clock_setup(void)
+{
+    power_step(sim_cfg.clock_setup_time, sim_cfg.p_active);
+}
+
+void msp_watchdog_enable(unsigned bits)
+{
+    watchdog_on = true;
+}
+
+void msp_watchdog_disable(void)
+{
+    watchdog_on = false;
+}
+
+void msp_watchdog_hold(void)
+{
+}
+
+void msp_watchdog_release(void)
+{
+}
+
+void msp_sleep(unsigned ticks)
+{
+    run((double)ticks / SIM_SLEEP_TIMER_FREQ, sim_cfg.p_lpm);
+}
+
+void msp_alarm(unsigned ticks, msp_alarm_cb_t cb)
+{
+    alarm_time = sim->t + (double)ticks / SIM_SLEEP_TIMER_FREQ;
+    alarm_cb = cb;
+}
+
+// libcapybara
+
+void capybara_config_pins(void)
+{
+}
+
+void capybara_wait_for_supply(void)
+{
+    // The simulator boots us only once the bank is charged
+}
+
+void capybara_shutdown(void)
+{
+    sim_exit(SIM_EXIT_SHUTDOWN);
+}
+
+void capybara_vboost_ok_isr(void)
+{
+}
+
+// libmspuartlink: the app sends at most one output packet per power-on
+
+void uartlink_open_rx(void)
+{
+    uartlink_rx_open = true;
+    if (isinf(app_data_time) && rng_uniform() < sim_cfg.app_prob)
+        app_data_time = sim->t + rng_uniform() * sim_cfg.app_delay;
+}
+
+void uartlink_close(void)
+{
+    uartlink_rx_open = false;
+}
+
+unsigned uartlink_receive(uint8_t *payload)
+{
+    if (!uartlink_rx_open || !app_data_arrived)
+        return 0;
+
+    for (unsigned i = 0; i < sim_cfg.app_len; ++i)
+        payload[i] = (uint8_t)(rng_uniform() * 256);
+    app_data_arrived = false;
+    app_data_time = INFINITY;
+    return sim_cfg.app_len;
+}
+
+// libsprite
+
+void SpriteRadio_SpriteRadio(void)
+{
+}
+
+void SpriteRadio_txInit(void)
+{
+    run(sim_cfg.radio_init_time, sim_cfg.p_active);
+}
+
+void SpriteRadio_transmit(char bytes[], unsigned length)
+{
+    run(length * sim_cfg.radio_byte_time, sim_cfg.p_radio);
+
+    sim->bytes_tx += length;
+    if (length == sizeof(rad_pkt_t)) {
+        rad_pkt_union_t pkt;
+        memcpy(&pkt.raw, bytes, sizeof(pkt.raw));
+        ++sim->chunks_tx;
+
+        // Header chunk of a multibyte pkt carries the size
+        if (pkt.typed.idx == 0) {
+            multibyte_pkt_hdr_union_t hdr = { .raw = pkt.typed.payload_byte };
+            sim->mb_pkt_size[pkt.typed.type] = hdr.typed.size;
+        } else if (pkt.typed.idx == sim->mb_pkt_size[pkt.typed.type]) {
+            ++sim->pkts_sent;
+        }
+    } else {
+        ++sim->beacons;
+    }
+
+    channel_transmit((uint8_t *)bytes, length);
+}
+
+void SpriteRadio_sleep(void)
+{
+}
+
+// libedbserver
+
+void edb_server_init(void)
+{
+}
+
+void edb_set_watchpoint_callback(watchpoint_callback_t cb)
+{
+    watchpoint_cb = cb;
+}
+
+void toggle_watchpoint(unsigned index, bool enable, bool vcap_snapshot)
+{
+    watchpoint_enabled[index] = enable;
+    watchpoint_vcap[index] = vcap_snapshot;
+}
+
+void enable_watchpoints(void)
+{
+    watchpoints_on = true;
+}
+
+void disable_watchpoints(void)
+{
+    watchpoints_on = false;
+}
+
+// Entry point of a boot in the child process
+int fw_main(void);
+
+void sim_boot()
+{
+    struct sigaction sa = { .sa_sigaction = flash_fault, .sa_flags = SA_SIGINFO };
+    sigaction(SIGSEGV, &sa, NULL);
+    flash_protect();
+    for (unsigned i = 0; i < NUM_EVENTS; ++i)
+        watchpoint_next[i] = INFINITY;
+
+    boot_start = sim->t;
+    ++sim->boots;
+    power_step(sim_cfg.boot_time, sim_cfg.p_active);
+
+    fw_main();
+    sim_exit(SIM_EXIT_RETURNED);
+}
@@ -0,0 +1,366 @@
+// Mission simulator: boots the firmware (main() in src/main.c) over and over
+// against models of the energy harvester and supercap bank, the app on the
+// target, and the radio channel to the ground station.
+//
+// Each boot runs in a forked child process, so that firmware RAM starts fresh
+// on each boot, while flash and the model state persist in shared memory.
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <msp430.h>
+
+#include "sim.h"
+#include "profile.h"
+
+#if NUM_EVENTS > WORKLOAD_MAX_WATCHPOINTS
+#error Workload model supports fewer watchpoints than NUM_EVENTS
+#endif
+
+// Time step while charging with the MCU off
+#define CHARGE_STEP 1.0 // s
+
+sim_config_t sim_cfg = {
+    .days = 7,
+    .seed = 1,
+
+    .p_harvest = 0.020,
+    .orbit_period = 92 * 60,
+    .eclipse = 35 * 60,
+    .tumble_period = 60,
+    .eta_in = 0.8,
+    .eta_out = 0.85,
+
+    .capacitance = 0.1,
+    .leakage = 5e-6,
+    .v_boot = 2.5,
+    .v_max = 2.6,
+    .v_off = 1.8,
+
+    .p_active = 0.003,
+    .p_lpm = 0.0003,
+    .p_app = 0.002,
+    .p_radio = 0.1,
+    .p_flash = 0.006,
+    .boot_time = 0.01,
+    .clock_setup_time = 0.001,
+    .radio_init_time = 0.005,
+    .radio_byte_time = 0.07,
+    .flash_word_time = 75e-6,
+    .flash_erase_time = 0.025,
+    .isr_time = 40e-6,
+    .snapshot_time = 20e-6,
+    .watchdog = 256,
+    .adc_noise = 4,
+
+    .wp_rate = { 0.5, 0.5, 0.5, 0.5 },
+    .app_prob = 0.5,
+    .app_delay = 5,
+    .app_len = 8,
+
+    .ber = 1e-3,
+    .drop = 0.01,
+    .visibility = 1.0,
+    .noise = 0.0,
+};
+
+sim_state_t *sim;
+
+int sim_rx_fd = -1;
+int sim_saved_fd = -1;
+
+// xorshift64*
+static uint64_t rng_next()
+{
+    uint64_t x = sim->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    sim->rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+double rng_uniform()
+{
+    return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double rng_normal()
+{
+    double u1 = rng_uniform(), u2 = rng_uniform();
+    return sqrt(-2 * log(u1 + 1e-300)) * cos(2 * M_PI * u2);
+}
+
+double rng_exp(double rate)
+{
+    return -log(1.0 - rng_uniform()) / rate;
+}
+
+void sim_exit(sim_exit_t code)
+{
+    _exit(code);
+}
+
+static void charge()
+{
+    while (sim->vbank < sim_cfg.v_boot)
+        energy_step(CHARGE_STEP, 0, true);
+}
+
+static void report(FILE *f)
+{
+    double days = sim->t / (24 * 3600);
+    unsigned long saved = sim->pkts_saved[0] + sim->pkts_saved[1];
+
+    fprintf(f, "sim_days %.3f\n", days);
+    fprintf(f, "boots %lu\n", sim->boots);
+    fprintf(f, "brownouts %lu\n", sim->brownouts);
+    fprintf(f, "watchdog_resets %lu\n", sim->watchdog_resets);
+    fprintf(f, "beacons %lu\n", sim->beacons);
+    fprintf(f, "watchpoint_events %lu\n", sim->watchpoint_events);
+    fprintf(f, "profiles_saved %lu\n", sim->pkts_saved[0]);
+    fprintf(f, "app_pkts_saved %lu\n", sim->pkts_saved[1]);
+    fprintf(f, "profiles_stopped_vcap %lu\n", sim->profile_stops[1]);
+    fprintf(f, "profiles_stopped_overflow %lu\n", sim->profile_stops[2]);
+    fprintf(f, "profiles_stopped_timeout %lu\n", sim->profile_stops[3]);
+    fprintf(f, "pkts_sent %lu\n", sim->pkts_sent);
+    fprintf(f, "pkts_erased %lu\n", sim->pkts_erased);
+    fprintf(f, "pkts_pending %lu\n", saved - sim->pkts_sent - sim->pkts_erased);
+    fprintf(f, "flash_erases %lu\n", sim->flash_erases);
+    fprintf(f, "flash_bytes_written %lu\n", sim->flash_bytes_written);
+    fprintf(f, "chunks_tx %lu\n", sim->chunks_tx);
+    fprintf(f, "bytes_tx %lu\n", sim->bytes_tx);
+    fprintf(f, "bytes_heard %lu\n", sim->bytes_heard);
+    fprintf(f, "bytes_dropped %lu\n", sim->bytes_dropped);
+    fprintf(f, "bit_errors %lu\n", sim->bit_errors);
+    fprintf(f, "energy_harvested_J %.3f\n", sim->energy_harvested);
+    fprintf(f, "energy_used_J %.3f\n", sim->energy_used);
+    if (days > 0) {
+        fprintf(f, "boots_per_day %.1f\n", sim->boots / days);
+        fprintf(f, "profiles_saved_per_day %.2f\n", sim->pkts_saved[0] / days);
+        fprintf(f, "pkts_sent_per_day %.2f\n", sim->pkts_sent / days);
+        fprintf(f, "flash_erases_per_day %.2f\n", sim->flash_erases / days);
+    }
+    if (saved > 0)
+        fprintf(f, "pkts_erased_fraction %.3f\n", (double)sim->pkts_erased / saved);
+}
+
+static void usage(FILE *f, const char *prog)
+{
+    fprintf(f,
+        "Usage: %s [options]\n"
+        "Simulates a mission and prints statistics (see also edbsat-sim-report).\n"
+        "  --days D            duration of simulated mission (%g)\n"
+        "  --seed N            seed for the random models (%llu)\n"
+        "  --harvester NAME    energy harvester model (orbit):\n",
+        prog, sim_cfg.days, (unsigned long long)sim_cfg.seed);
+    harvester_list(f);
+    fprintf(f,
+        "  --p-harvest W       peak harvested power (%g)\n"
+        "  --orbit S           orbit period (%g)\n"
+        "  --eclipse S         eclipse duration per orbit (%g)\n"
+        "  --capacitance F     supercap bank capacitance (%g)\n"
+        "  --v-boot V          bank voltage at which MCU boots (%g)\n"
+        "  --v-off V           bank voltage at which MCU browns out (%g)\n"
+        "  --p-app W           power drawn by the app device (%g)\n"
+        "  --p-radio W         power drawn during transmission (%g)\n"
+        "  --workload NAME     watchpoint workload model (poisson):\n",
+        sim_cfg.p_harvest, sim_cfg.orbit_period, sim_cfg.eclipse,
+        sim_cfg.capacitance, sim_cfg.v_boot, sim_cfg.v_off,
+        sim_cfg.p_app, sim_cfg.p_radio);
+    workload_list(f);
+    fprintf(f,
+        "  --rates R0,R1,...   events/s at each watchpoint\n"
+        "  --app-prob P        probability that app sends output in a run (%g)\n"
+        "  --ber P             bit error rate on radio channel (%g)\n"
+        "  --drop P            probability of losing a byte on the channel (%g)\n"
+        "  --visibility P      probability that ground hears a transmission (%g)\n"
+        "  --noise P           probability of a spurious byte after a transmission (%g)\n"
+        "  --rx FILE           save bytes received on the ground to file\n"
+        "  --saved FILE        log packets saved to flash to file\n"
+        "  --verbose           print firmware console output\n"
+        "  --bench-profile N   time the watchpoint callback over N events, and exit\n",
+        sim_cfg.app_prob, sim_cfg.ber, sim_cfg.drop, sim_cfg.visibility, sim_cfg.noise);
+}
+
+enum {
+    OPT_DAYS = 256, OPT_SEED, OPT_HARVESTER, OPT_P_HARVEST, OPT_ORBIT, OPT_ECLIPSE,
+    OPT_CAPACITANCE, OPT_V_BOOT, OPT_V_OFF, OPT_P_APP, OPT_P_RADIO,
+    OPT_WORKLOAD, OPT_RATES, OPT_APP_PROB, OPT_BER, OPT_DROP, OPT_VISIBILITY,
+    OPT_NOISE, OPT_RX, OPT_SAVED, OPT_VERBOSE, OPT_BENCH_PROFILE, OPT_HELP,
+};
+
+static const struct option options[] = {
+    { "days",        required_argument, NULL, OPT_DAYS },
+    { "seed",        required_argument, NULL, OPT_SEED },
+    { "harvester",   required_argument, NULL, OPT_HARVESTER },
+    { "p-harvest",   required_argument, NULL, OPT_P_HARVEST },
+    { "orbit",       required_argument, NULL, OPT_ORBIT },
+    { "eclipse",     required_argument, NULL, OPT_ECLIPSE },
+    { "capacitance", required_argument, NULL, OPT_CAPACITANCE },
+    { "v-boot",      required_argument, NULL, OPT_V_BOOT },
+    { "v-off",       required_argument, NULL, OPT_V_OFF },
+    { "p-app",       required_argument, NULL, OPT_P_APP },
+    { "p-radio",     required_argument, NULL, OPT_P_RADIO },
+    { "workload",    required_argument, NULL, OPT_WORKLOAD },
+    { "rates",       required_argument, NULL, OPT_RATES },
+    { "app-prob",    required_argument, NULL, OPT_APP_PROB },
+    { "ber",         required_argument, NULL, OPT_BER },
+    { "drop",        required_argument, NULL, OPT_DROP },
+    { "visibility",  required_argument, NULL, OPT_VISIBILITY },
+    { "noise",       required_argument, NULL, OPT_NOISE },
+    { "rx",          required_argument, NULL, OPT_RX },
+    { "saved",       required_argument, NULL, OPT_SAVED },
+    { "verbose",     no_argument,       NULL, OPT_VERBOSE },
+    { "bench-profile", required_argument, NULL, OPT_BENCH_PROFILE },
+    { "help",        no_argument,       NULL, OPT_HELP },
+    { NULL, 0, NULL, 0 },
+};
+
+static void parse_rates(const char *s)
+{
+    unsigned i = 0;
+    char *end;
+    while (i < WORKLOAD_MAX_WATCHPOINTS) {
+        sim_cfg.wp_rate[i++] = strtod(s, &end);
+        if (*end != ',')
+            break;
+        s = end + 1;
+    }
+    while (i < WORKLOAD_MAX_WATCHPOINTS)
+        sim_cfg.wp_rate[i++] = 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *harvester = "orbit";
+    const char *workload = "poisson";
+    unsigned long bench_events = 0;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (opt) {
+            case OPT_DAYS:        sim_cfg.days = atof(optarg); break;
+            case OPT_SEED:        sim_cfg.seed = strtoull(optarg, NULL, 0); break;
+            case OPT_HARVESTER:   harvester = optarg; break;
+            case OPT_P_HARVEST:   sim_cfg.p_harvest = atof(optarg); break;
+            case OPT_ORBIT:       sim_cfg.orbit_period = atof(optarg); break;
+            case OPT_ECLIPSE:     sim_cfg.eclipse = atof(optarg); break;
+            case OPT_CAPACITANCE: sim_cfg.capacitance = atof(optarg); break;
+            case OPT_V_BOOT:      sim_cfg.v_boot = atof(optarg); break;
+            case OPT_V_OFF:       sim_cfg.v_off = atof(optarg); break;
+            case OPT_P_APP:       sim_cfg.p_app = atof(optarg); break;
+            case OPT_P_RADIO:     sim_cfg.p_radio = atof(optarg); break;
+            case OPT_WORKLOAD:    workload = optarg; break;
+            case OPT_RATES:       parse_rates(optarg); break;
+            case OPT_APP_PROB:    sim_cfg.app_prob = atof(optarg); break;
+            case OPT_BER:         sim_cfg.ber = atof(optarg); break;
+            case OPT_DROP:        sim_cfg.drop = atof(optarg); break;
+            case OPT_VISIBILITY:  sim_cfg.visibility = atof(optarg); break;
+            case OPT_NOISE:       sim_cfg.noise = atof(optarg); break;
+            case OPT_RX:          sim_cfg.rx_file = optarg; break;
+            case OPT_SAVED:       sim_cfg.saved_file = optarg; break;
+            case OPT_VERBOSE:     sim_cfg.verbose = true; break;
+            case OPT_BENCH_PROFILE: bench_events = strtoul(optarg, NULL, 0); break;
+            case OPT_HELP:        usage(stdout, argv[0]); return 0;
+            default:              usage(stderr, argv[0]); return 1;
+        }
+    }
+
+    if (bench_events > 0) {
+        sim_bench_profile(bench_events);
+        return 0;
+    }
+
+    sim_cfg.harvester = harvester_find(harvester);
+    if (!sim_cfg.harvester) {
+        fprintf(stderr, "unknown harvester model: %s\n", harvester);
+        return 1;
+    }
+    sim_cfg.workload = workload_find(workload);
+    if (!sim_cfg.workload) {
+        fprintf(stderr, "unknown workload model: %s\n", workload);
+        return 1;
+    }
+
+    if (sim_cfg.rx_file) {
+        sim_rx_fd = open(sim_cfg.rx_file, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (sim_rx_fd < 0) {
+            perror(sim_cfg.rx_file);
+            return 1;
+        }
+    }
+    if (sim_cfg.saved_file) {
+        sim_saved_fd = open(sim_cfg.saved_file, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (sim_saved_fd < 0) {
+            perror(sim_cfg.saved_file);
+            return 1;
+        }
+    }
+
+    sim = mmap(NULL, sizeof(sim_state_t), PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sim == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(sim, 0, sizeof(sim_state_t));
+
+    // Page-aligned, so that the firmware's writes to flash can be trapped
+    sim_info_mem = mmap(NULL, SIM_INFO_MEM_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sim_info_mem == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    memset(sim_info_mem, 0xff, SIM_INFO_MEM_SIZE); // erased
+    sim->rng = sim_cfg.seed ? sim_cfg.seed : 1;
+
+    double duration = sim_cfg.days * 24 * 3600;
+    while (sim->t < duration) {
+        charge();
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0)
+            sim_boot();
+
+        int status;
+        if (waitpid(pid, &status, 0) < 0) {
+            perror("waitpid");
+            return 1;
+        }
+        if (!WIFEXITED(status)) {
+            fprintf(stderr, "boot %lu: firmware crashed (status %d)\n", sim->boots, status);
+            return 1;
+        }
+
+        switch (WEXITSTATUS(status)) {
+            case SIM_EXIT_SHUTDOWN:
+                break;
+            case SIM_EXIT_BROWNOUT:
+                ++sim->brownouts;
+                break;
+            case SIM_EXIT_WATCHDOG:
+                ++sim->watchdog_resets;
+                break;
+            default:
+                fprintf(stderr, "boot %lu: unexpected exit: %d\n",
+                        sim->boots, WEXITSTATUS(status));
+                return 1;
+        }
+    }
+
+    report(stdout);
+    return 0;
+}
@@ -0,0 +1,115 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "energy.h"
+#include "workload.h"
+
+// Exit codes of a boot (one child process per boot)
+typedef enum {
+    SIM_EXIT_SHUTDOWN = 0, // firmware called capybara_shutdown()
+    SIM_EXIT_BROWNOUT = 10,
+    SIM_EXIT_WATCHDOG = 11,
+    SIM_EXIT_RETURNED = 12, // firmware main() returned (should not happen)
+} sim_exit_t;
+
+// Parameters of the models, set from the command line
+typedef struct {
+    double days;
+    uint64_t seed;
+
+    const harvester_t *harvester;
+    double p_harvest;       // W, peak harvested power
+    double orbit_period;    // s
+    double eclipse;         // s, duration of eclipse in each orbit
+    double tumble_period;   // s
+    double eta_in;          // harvester to bank efficiency
+    double eta_out;         // bank to load efficiency (booster)
+
+    double capacitance;     // F
+    double leakage;         // A
+    double v_boot;          // V, bank voltage at which the MCU boots
+    double v_max;           // V, bank voltage clamp
+    double v_off;           // V, bank voltage at which the booster browns out
+
+    double p_active;        // W, MCU active
+    double p_lpm;           // W, MCU in LPM
+    double p_app;           // W, app device when powered
+    double p_radio;         // W, during transmission
+    double p_flash;         // W, during flash program or erase
+    double boot_time;       // s, from power-on until main()
+    double clock_setup_time;// s, until the DCO settles in msp_clock_setup()
+    double radio_init_time; // s
+    double radio_byte_time; // s, on-air time per byte
+    double flash_word_time; // s
+    double flash_erase_time;// s
+    double isr_time;        // s, per watchpoint callback
+    double snapshot_time;   // s, per ADC conversion of Vcap for a watchpoint
+    double watchdog;        // s, 0 to disable
+    double adc_noise;       // LSB, std dev
+
+    const workload_t *workload;
+    double wp_rate[WORKLOAD_MAX_WATCHPOINTS]; // events/s at each watchpoint
+    double app_prob;        // probability that app sends output in a run
+    double app_delay;       // s, max delay after power-on until app output
+    unsigned app_len;       // bytes of app output
+
+    double ber;             // bit error rate on the radio channel
+    double drop;            // probability of losing a byte
+    double visibility;      // probability that a transmission is heard
+    double noise;           // probability of a spurious byte after a transmission
+
+    const char *rx_file;    // bytes received by the ground station
+    const char *saved_file; // log of packets saved to flash (ground truth)
+    bool verbose;           // print firmware console output
+} sim_config_t;
+
+// State that persists across boots, shared between the simulator and the
+// child process that runs each boot
+typedef struct {
+    double t;               // s, simulated time
+    double vbank;           // V
+    uint64_t rng;
+
+    double energy_harvested; // J
+    double energy_used;      // J
+
+    unsigned long boots;
+    unsigned long brownouts;
+    unsigned long watchdog_resets;
+    unsigned long beacons;
+    unsigned long chunks_tx;
+    unsigned long bytes_tx;
+    unsigned long bytes_heard;
+    unsigned long bytes_dropped;
+    unsigned long bit_errors;
+    unsigned long flash_erases;
+    unsigned long flash_bytes_written;
+    unsigned long watchpoint_events;
+
+    unsigned long pkts_saved[2]; // by pkt_type_t
+    unsigned long pkts_sent;     // transmitted all chunks
+    unsigned long pkts_erased;   // erased before completely sent
+    unsigned long profile_stops[4]; // profiles saved, by profile_stop_t in the descriptor
+    unsigned mb_pkt_size[2];     // size of the multibyte pkt being sent, by type
+} sim_state_t;
+
+extern sim_config_t sim_cfg;
+extern sim_state_t *sim;
+
+extern int sim_rx_fd;
+extern int sim_saved_fd;
+
+double rng_uniform();
+double rng_normal();
+double rng_exp(double rate);
+
+void sim_boot() __attribute__((noreturn));
+void sim_exit(sim_exit_t code) __attribute__((noreturn));
+
+// Time the watchpoint callback on the host, and print the results (bench.c)
+void sim_bench_profile(unsigned long events);
+
+#endif // SIM_H
@@ -0,0 +1,76 @@
+// Wrappers around firmware functions called from main(), to keep count of
+// packets saved to flash and of packets lost to erases (see SIM_WRAP).
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "payload.h"
+
+flash_status_t __real_save_payload(flash_loc_t *loc, pkt_type_t pkt_type, uint8_t *pkt_data, unsigned len);
+bool __real_flash_erase();
+
+static bool evicting; // erase is part of an eviction, which keeps some pkts
+
+static void saved(pkt_type_t pkt_type, uint8_t *pkt_data, unsigned len)
+{
+    ++sim->pkts_saved[pkt_type];
+
+    // Log in the format of the ground decoder output, for matching
+    if (sim_saved_fd >= 0) {
+        char line[64];
+        int n = snprintf(line, sizeof(line), "%.3f %u", sim->t, pkt_type);
+        for (unsigned i = 0; i < len && n < sizeof(line) - 4; ++i)
+            n += snprintf(line + n, sizeof(line) - n, " %02x", pkt_data[i]);
+        line[n++] = '\n';
+        write(sim_saved_fd, line, n);
+    }
+}
+
+flash_status_t __wrap_save_payload(flash_loc_t *loc, pkt_type_t pkt_type, uint8_t *pkt_data, unsigned len)
+{
+    flash_status_t rc = __real_save_payload(loc, pkt_type, pkt_data, len);
+    if (rc == FLASH_STATUS_OK)
+        saved(pkt_type, pkt_data, len);
+    return rc;
+}
+
+#ifdef CONFIG_COLLECT_ENERGY_PROFILE
+flash_status_t __real_save_profile_payload(flash_loc_t *loc, uint8_t *pkt_data, unsigned len,
+                                           profile_stop_t stop);
+
+flash_status_t __wrap_save_profile_payload(flash_loc_t *loc, uint8_t *pkt_data, unsigned len,
+                                           profile_stop_t stop)
+{
+    flash_status_t rc = __real_save_profile_payload(loc, pkt_data, len, stop);
+    if (rc == FLASH_STATUS_OK) {
+        saved(PKT_TYPE_ENERGY_PROFILE, pkt_data, len);
+        ++sim->profile_stops[stop];
+    }
+    return rc;
+}
+#endif // CONFIG_COLLECT_ENERGY_PROFILE
+
+bool __wrap_flash_erase()
+{
+    bool rc = __real_flash_erase();
+    if (rc && !evicting) {
+        unsigned long saved = sim->pkts_saved[0] + sim->pkts_saved[1];
+        sim->pkts_erased = saved - sim->pkts_sent;
+    }
+    return rc;
+}
+
+#ifdef CONFIG_PKT_QUEUES
+flash_status_t __real_pkt_store_evict(unsigned len, unsigned *evicted);
+
+flash_status_t __wrap_pkt_store_evict(unsigned len, unsigned *evicted)
+{
+    evicting = true;
+    flash_status_t rc = __real_pkt_store_evict(len, evicted);
+    evicting = false;
+    if (rc == FLASH_STATUS_OK)
+        sim->pkts_erased += *evicted;
+    return rc;
+}
+#endif // CONFIG_PKT_QUEUES
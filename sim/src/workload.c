@@ -0,0 +1,46 @@
+#include <math.h>
+#include <string.h>
+
+#include "sim.h"
+#include "workload.h"
+
+// Independent Poisson processes at each watchpoint
+static double poisson_next(unsigned idx, double t, bool first)
+{
+    double rate = sim_cfg.wp_rate[idx];
+    if (rate <= 0.0)
+        return INFINITY;
+    return t + rng_exp(rate);
+}
+
+// Periodic app loop with a random phase on each power-on and 5% jitter
+static double periodic_next(unsigned idx, double t, bool first)
+{
+    double rate = sim_cfg.wp_rate[idx];
+    if (rate <= 0.0)
+        return INFINITY;
+    double period = 1.0 / rate;
+    if (first)
+        return t + rng_uniform() * period;
+    double next = t + period * (1.0 + 0.05 * rng_normal());
+    return next > t ? next : t;
+}
+
+static const workload_t workloads[] = {
+    { "poisson",  "independent random events at the given rates", poisson_next },
+    { "periodic", "events at fixed periods (1/rate) with jitter",  periodic_next },
+};
+
+const workload_t *workload_find(const char *name)
+{
+    for (unsigned i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i)
+        if (!strcmp(workloads[i].name, name))
+            return &workloads[i];
+    return NULL;
+}
+
+void workload_list(FILE *f)
+{
+    for (unsigned i = 0; i < sizeof(workloads) / sizeof(workloads[0]); ++i)
+        fprintf(f, "  %-8s %s\n", workloads[i].name, workloads[i].help);
+}
@@ -0,0 +1,21 @@
+#ifndef SIM_WORKLOAD_H
+#define SIM_WORKLOAD_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define WORKLOAD_MAX_WATCHPOINTS 8
+
+// Times at which the app on the target hits each watchpoint
+typedef struct {
+    const char *name;
+    const char *help;
+    // Time of the next event at watchpoint idx after time t; first is set
+    // on the first call after the app powers on
+    double (*next_event)(unsigned idx, double t, bool first);
+} workload_t;
+
+const workload_t *workload_find(const char *name);
+void workload_list(FILE *f);
+
+#endif // SIM_WORKLOAD_H
@@ -0,0 +1,151 @@
+#include <msp430.h>
+#include <string.h>
+
+#include <libio/console.h>
+
+#include "accum.h"
+#include "flash.h"
+
+// The segment holds a log of words, appended without erasing (programming
+// can only clear bits):
+//   SUM(flags, runs)  followed by one word of bin sums per event
+//   RESET             the sum was saved to the pkt store, start a new one
+// The last SUM after the last RESET is current. A SUM is written with the
+// UNCOMMITTED bit set, which is cleared once its bins are written, so that
+// a torn record is skipped. Erased when full, so one erase every segment's
+// worth of runs; a brownout between the erase and the write loses the sum.
+#define ACCUM_WORD_ERASED        0xFFFF
+#define ACCUM_WORD_RESET         0x8000
+#define ACCUM_WORD_SUM           0x4000
+#define ACCUM_WORD_TYPE_MASK     0xC000
+#define ACCUM_SUM_UNCOMMITTED    0x2000
+#define ACCUM_SUM_FLAGS_SHIFT    8
+#define ACCUM_SUM_FLAGS_MASK     0x1F
+#define ACCUM_SUM_RUNS_MASK      0xFF
+
+#define ACCUM_ADDR  ((uint16_t *)FLASH_ACCUM_SEGMENT)
+#define ACCUM_WORDS (FLASH_ACCUM_SEGMENT_SIZE / 2)
+
+#define ACCUM_SUM_WORDS (1 + NUM_EVENTS)
+#if ACCUM_SUM_WORDS > ACCUM_WORDS
+#error Accumulation segment too small: FLASH_ACCUM_SEGMENT_SIZE
+#endif
+
+#if PROFILING_ACCUMULATE_RUNS > 0xFF
+#error Run count of the sum is 8 bits: PROFILING_ACCUMULATE_RUNS
+#endif
+
+profile_sum_t profile_sum;
+uint8_t profile_sum_flags;
+
+// Replays the log into profile_sum, and returns the next free word, or NULL
+// if the log is corrupt
+static uint16_t *replay()
+{
+    uint16_t *w = ACCUM_ADDR;
+
+    memset(&profile_sum, 0, sizeof(profile_sum_t));
+    profile_sum_flags = 0;
+
+    while (w < ACCUM_ADDR + ACCUM_WORDS) {
+        uint16_t word = *w;
+
+        if (word == ACCUM_WORD_ERASED) {
+            break;
+        } else if (word == ACCUM_WORD_RESET) {
+            memset(&profile_sum, 0, sizeof(profile_sum_t));
+            profile_sum_flags = 0;
+            ++w;
+        } else if ((word & ACCUM_WORD_TYPE_MASK) == ACCUM_WORD_SUM) {
+            if (w + ACCUM_SUM_WORDS > ACCUM_ADDR + ACCUM_WORDS) {
+                LOG("AC: sum overruns log\r\n");
+                return NULL;
+            }
+            if (!(word & ACCUM_SUM_UNCOMMITTED)) {
+                profile_sum.runs = word & ACCUM_SUM_RUNS_MASK;
+                profile_sum_flags = (word >> ACCUM_SUM_FLAGS_SHIFT) & ACCUM_SUM_FLAGS_MASK;
+                for (int i = 0; i < NUM_EVENTS; ++i) {
+                    uint16_t bins = *(w + 1 + i);
+                    profile_sum.bins[i][0] = bins & 0xFF;
+                    profile_sum.bins[i][1] = bins >> 8;
+                }
+            }
+            w += ACCUM_SUM_WORDS;
+        } else {
+            LOG("AC: invalid word 0x%04x\r\n", word);
+            return NULL;
+        }
+    }
+    return w;
+}
+
+// Returns a free area of 'words' words at the end of the log, erasing the
+// log if it is full or corrupt (the sum in RAM is already replayed)
+static uint16_t *alloc_words(unsigned words)
+{
+    uint16_t *w = replay();
+    if (w == NULL) {
+        memset(&profile_sum, 0, sizeof(profile_sum_t)); // not trusted
+        profile_sum_flags = 0;
+    }
+    if (w == NULL || w + words > ACCUM_ADDR + ACCUM_WORDS) {
+        LOG("AC: erase log\r\n");
+        flash_erase_segment((uint8_t *)ACCUM_ADDR);
+        w = ACCUM_ADDR;
+    }
+    return w;
+}
+
+static uint8_t add_saturated(uint8_t sum, uint8_t v)
+{
+    return sum < PROFILE_SUM_BIN_MAX - v ? sum + v : PROFILE_SUM_BIN_MAX;
+}
+
+bool accum_add(const profile_t *prof, bool partial, profile_stop_t stop)
+{
+    uint16_t *w = alloc_words(ACCUM_SUM_WORDS);
+
+    bool due = false;
+    for (int i = 0; i < NUM_EVENTS; ++i) {
+        const event_t *event = &prof->events[i];
+        uint8_t *bins = profile_sum.bins[i];
+        bins[0] = add_saturated(bins[0], event->ehist_bin0);
+        bins[1] = add_saturated(bins[1], event->ehist_bin1);
+        due |= bins[0] > PROFILE_SUM_BIN_MAX - PROFILE_EHIST_BIN_MASK ||
+               bins[1] > PROFILE_SUM_BIN_MAX - PROFILE_EHIST_BIN_MASK;
+    }
+    ++profile_sum.runs;
+    due |= profile_sum.runs >= PROFILING_ACCUMULATE_RUNS;
+
+    profile_sum_flags &= ~(0x3 << PROFILE_SUM_STOP_SHIFT);
+    profile_sum_flags |= stop << PROFILE_SUM_STOP_SHIFT;
+    if (partial)
+        profile_sum_flags |= PROFILE_SUM_PARTIAL;
+    if (stop == PROFILE_STOP_OVERFLOW)
+        profile_sum_flags |= PROFILE_SUM_OVERFLOW;
+
+    LOG("AC: add run: runs %u due %u\r\n", profile_sum.runs, due);
+
+    uint16_t hdr = ACCUM_WORD_SUM | (profile_sum_flags << ACCUM_SUM_FLAGS_SHIFT) |
+                   profile_sum.runs;
+    flash_write_word(w, hdr | ACCUM_SUM_UNCOMMITTED);
+    for (int i = 0; i < NUM_EVENTS; ++i) {
+        const uint8_t *bins = profile_sum.bins[i];
+        flash_write_word(w + 1 + i, bins[0] | ((uint16_t)bins[1] << 8));
+    }
+    flash_write_word(w, hdr);
+
+    return due;
+}
+
+void accum_reset()
+{
+    LOG("AC: reset\r\n");
+
+    uint16_t *w = alloc_words(1);
+    if (w != ACCUM_ADDR) // else the log is empty, which is a reset too
+        flash_write_word(w, ACCUM_WORD_RESET);
+
+    memset(&profile_sum, 0, sizeof(profile_sum_t));
+    profile_sum_flags = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef ACCUM_H
+#define ACCUM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "profile.h"
+
+// Sum of the profiles of several runs. The count of an event is not kept: it
+// is the sum of its bins (see profile_event), so the bins carry all of it.
+#define PROFILE_SUM_BIN_MAX 0xFF
+
+typedef struct __attribute__((packed)) {
+    uint8_t runs;
+    uint8_t bins[NUM_EVENTS][2]; // sums of ehist_bin0 and ehist_bin1
+} profile_sum_t;
+
+// Flags of the sum, as for the profile pkt (see payload.h)
+#define PROFILE_SUM_PARTIAL    0x01 // a run was recovered from a checkpoint
+#define PROFILE_SUM_OVERFLOW   0x02 // a run stopped on counter overflow
+#define PROFILE_SUM_STOP_SHIFT 3    // 2 bits: why the last run stopped
+
+extern profile_sum_t profile_sum;
+extern uint8_t profile_sum_flags;
+
+// Add the profile of a run to the sum persisted in flash. Returns true if
+// the sum is due to be sent: PROFILING_ACCUMULATE_RUNS runs are in it, or
+// a bin sum might saturate in the next run.
+bool accum_add(const profile_t *prof, bool partial, profile_stop_t stop);
+// Start a new sum, once the current one was saved to the pkt store
+void accum_reset();
+
+#endif // ACCUM_H
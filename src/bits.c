@@ -8,3 +8,14 @@ unsigned find_first_set_bit_in_word(uint16_t word)
     return b;
 }
 
+uint8_t encode_ticks(uint16_t ticks)
+{
+    if (ticks < 16)
+        return ticks;
+
+    unsigned exp = 1;
+    while ((ticks >> (exp - 1)) >= 32)
+        ++exp;
+    return (exp << 4) | ((ticks >> (exp - 1)) & 0xF);
+}
+
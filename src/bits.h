@@ -5,4 +5,9 @@
 
 unsigned find_first_set_bit_in_word(uint16_t word);
 
+// Timer ticks as a float in one byte, with a 4-bit exponent e and a 4-bit
+// mantissa m: m if e = 0, otherwise (16 + m) * 2^(e - 1), rounded down
+// (within 1/16)
+uint8_t encode_ticks(uint16_t ticks);
+
 #endif // BITS_H
@@ -0,0 +1,81 @@
+#include <msp430.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libio/console.h>
+
+#include "boottime.h"
+#include "bits.h"
+
+boot_timing_t boot_timing;
+
+static uint16_t last_mark; // timer count
+static volatile uint16_t timer_wraps; // since the last mark, counted by the ISR
+static uint16_t phase_ticks[NUM_BOOT_PHASES]; // before encoding, for the console
+
+void boot_timing_start()
+{
+    memset(&boot_timing, 0, sizeof(boot_timing));
+    memset(phase_ticks, 0, sizeof(phase_ticks));
+
+    // Timer_A2 counts continuously until the last mark, and interrupts on
+    // wrap around, so that a phase longer than a wrap saturates instead of
+    // being taken modulo the wrap
+    timer_wraps = 0;
+    TA2CTL = TASSEL_1 | ID_2 | TACLR | TAIE; // ACLK / 4
+    TA2CTL |= MC_2; // continuous
+
+    last_mark = TA2R;
+}
+
+void boot_timing_mark(boot_phase_t phase)
+{
+    __disable_interrupt();
+    uint16_t now = TA2R;
+    uint16_t wraps = timer_wraps;
+    // Wrapped before the read, but the ISR did not run yet: count it here. If
+    // it wrapped after the read, the ISR counts it into the next phase.
+    if ((TA2CTL & TAIFG) && !(now & 0x8000)) {
+        TA2CTL &= ~TAIFG;
+        ++wraps;
+    }
+    timer_wraps = 0;
+    if (phase == NUM_BOOT_PHASES - 1)
+        TA2CTL &= ~(MC_3 | TAIE); // stop, not to wake up the MCU every wrap
+    __enable_interrupt();
+
+    uint32_t elapsed = ((uint32_t)wraps << 16) + now - last_mark;
+    uint16_t ticks = elapsed > 0xFFFF ? 0xFFFF : elapsed;
+    last_mark = now;
+
+    phase_ticks[phase] = ticks;
+    boot_timing.durations[phase] = encode_ticks(ticks);
+}
+
+void boot_timing_log()
+{
+    LOG("boot timing (ticks at %u Hz):", BOOT_TIMER_FREQ);
+    for (unsigned phase = 0; phase < NUM_BOOT_PHASES; ++phase)
+        LOG(" %u", phase_ticks[phase]);
+    LOG("\r\n");
+}
+
+__attribute__ ((interrupt(TIMER2_A1_VECTOR)))
+void TIMER2_A1_ISR (void)
+{
+    switch (__even_in_range(TA2IV, TA2IV_TAIFG)) {
+        case TA2IV_TAIFG:
+            ++timer_wraps;
+            break;
+        default:
+            break;
+    }
+}
+
+// As for the energy budget, rand() alone is correlated with the task
+// selection: mix in the low bits of the timer, which vary with the time it
+// took for the supply to come up.
+bool boot_timing_due()
+{
+    return ((rand() ^ last_mark) & ((1 << BOOT_TIMING_PROBABILITY_LOG2) - 1)) == 0;
+}
@@ -0,0 +1,44 @@
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Duration of each phase of a boot, from entry into main() until the task is
+// chosen, from a free-running timer on ACLK. Timer_A0 and Timer_A1 are taken
+// by the console and by libmsp sleep, and Timer_B0 by the energy budget.
+
+typedef enum {
+    BOOT_PHASE_SUPPLY = 0,  // pin config and wait for supply
+    BOOT_PHASE_CLOCK,       // clock system (and clock scaling) setup
+    BOOT_PHASE_CONSOLE,     // console init and version banner (not in fast boot)
+    BOOT_PHASE_SEED,        // seed of the random generator
+    BOOT_PHASE_INIT,        // the rest, until the task is chosen
+    NUM_BOOT_PHASES
+} boot_phase_t;
+
+#define BOOT_TIMER_FREQ 8192 // Hz: ACLK / 4, wraps after 8 s
+
+// Durations are in timer ticks, as one-byte floats (see encode_ticks() in
+// bits.h), 0 if the phase did not happen, saturated at 0xFFFF ticks (8 s)
+// if longer
+typedef struct __attribute__((packed)) {
+    uint8_t durations[NUM_BOOT_PHASES];
+} boot_timing_t;
+
+extern boot_timing_t boot_timing;
+
+// Start the timer, call first thing in main()
+void boot_timing_start();
+
+// End the given phase (and start the next one), with interrupts enabled:
+// the wraps of the timer are counted by its ISR
+void boot_timing_mark(boot_phase_t phase);
+
+// Print the durations on the console
+void boot_timing_log();
+
+// Whether to save the durations of this boot, with the configured probability
+bool boot_timing_due();
+
+#endif // BOOTTIME_H
@@ -0,0 +1,55 @@
+#include <msp430.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libio/console.h>
+
+#include "budget.h"
+#include "power.h"
+#include "bits.h"
+
+budget_t budget;
+
+static uint16_t last_mark; // timer count
+static uint16_t adc_noise; // all bits of the Vbank samples, mixed
+
+static uint8_t sample_vbank()
+{
+    uint16_t vbank = sense_vbank();
+    adc_noise = ((adc_noise << 5) | (adc_noise >> 11)) ^ vbank;
+    return BUDGET_VBANK_TO_BYTE(vbank);
+}
+
+void budget_start()
+{
+    memset(&budget, 0, sizeof(budget));
+
+    // Timer_B0 counts continuously, and is not stopped until power off
+    TB0CTL = TBSSEL_1 | ID_3 | TBCLR; // ACLK / 8
+    TB0EX0 = TBIDEX_7; // further / 8
+    TB0CTL |= MC_2; // continuous
+
+    last_mark = TB0R;
+    budget.vbank = sample_vbank();
+}
+
+void budget_mark(budget_phase_t phase)
+{
+    uint16_t now = TB0R;
+    uint16_t ticks = now - last_mark; // correct across wrap around
+    last_mark = now;
+
+    budget_phase_rec_t *rec = &budget.phases[phase];
+    rec->duration = encode_ticks(ticks);
+    rec->vbank = sample_vbank();
+
+    LOG("budget: phase %u: ticks %u (%02x) vbank %02x\r\n", phase, ticks, rec->duration, rec->vbank);
+}
+
+// The rand() seed is one ADC sample of Vbank, at about the same level on
+// every boot, so it takes few distinct values, and a draw from rand() is
+// correlated with the task selection. Mix in the noise in this boot's samples.
+bool budget_due()
+{
+    return ((rand() ^ adc_noise) & ((1 << ENERGY_BUDGET_PROBABILITY_LOG2) - 1)) == 0;
+}
@@ -0,0 +1,48 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Energy budget of a boot: Vbank at the boundaries between phases of main(),
+// and the duration of each phase, from a free-running timer on ACLK.
+
+typedef enum {
+    BUDGET_PHASE_BOOT = 0,  // from after pin config, incl. wait for supply
+    BUDGET_PHASE_TRANSMIT,  // look up a saved pkt and send a chunk of it
+    BUDGET_PHASE_PROFILE,   // app powered on and profiled
+    BUDGET_PHASE_SAVE,      // profile and app output saved to flash
+    NUM_BUDGET_PHASES
+} budget_phase_t;
+
+#define BUDGET_TIMER_FREQ 512 // Hz: ACLK / 8 / 8, wraps after 128 s
+
+// Vbank as the top 8 bits of the ADC code (AVCC reference), with the top bit
+// flipped: Vbank in flight is in the top half of the range, where its byte
+// would often equal BEACON, and the ground station would lose the pkt.
+#define BUDGET_VBANK_TO_BYTE(v) ((uint8_t)((v) >> 4) ^ 0x80)
+
+// Durations are in timer ticks, as a one-byte float (see encode_ticks() in
+// bits.h). Keeps the pkt small enough for one flash_alloc().
+typedef struct __attribute__((packed)) {
+    uint8_t vbank;    // at end of phase
+    uint8_t duration; // 0 if phase did not happen
+} budget_phase_rec_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t vbank; // at start of boot phase
+    budget_phase_rec_t phases[NUM_BUDGET_PHASES];
+} budget_t;
+
+extern budget_t budget;
+
+// Start the timer and take the first Vbank sample
+void budget_start();
+
+// Record the end of the given phase, which started at the previous mark
+void budget_mark(budget_phase_t phase);
+
+// Whether to save the budget of this boot: with probability 1/2^ENERGY_BUDGET_PROBABILITY_LOG2
+bool budget_due();
+
+#endif // BUDGET_H
@@ -0,0 +1,190 @@
+#include <msp430.h>
+#include <string.h>
+
+#include <libio/console.h>
+
+#include "checkpoint.h"
+#include "flash.h"
+
+// The checkpoint segment holds a log of words, appended without erasing
+// (programming can only clear bits):
+//   START        beginning of a profiling run
+//   DELTA(mask)  followed by the current value of event_t for each event
+//                with a bit set in the mask
+//   END          the profile of the run was saved to the pkt store
+// A DELTA is written with the UNCOMMITTED bit set, which is cleared once all
+// its events are written, so that a torn record is skipped on recovery.
+#define CKPT_WORD_ERASED          0xFFFF
+#define CKPT_WORD_START           0xC000
+#define CKPT_WORD_END             0x8000
+#define CKPT_WORD_DELTA           0x4000
+#define CKPT_WORD_TYPE_MASK       0xC000
+#define CKPT_DELTA_UNCOMMITTED    0x2000
+#define CKPT_DELTA_EVENTS_MASK    ((1 << NUM_EVENTS) - 1)
+
+#define CKPT_ADDR  ((uint16_t *)FLASH_CHECKPOINT_SEGMENT)
+#define CKPT_WORDS (FLASH_CHECKPOINT_SEGMENT_SIZE / 2)
+
+// Words that a run may take: START, a DELTA with all events at each
+// checkpoint before the timeout, and END. Reserved when the run starts, so
+// that the log is never erased during the run, when the bank is low.
+#define CKPT_RUN_DELTAS ((PERIOD_PROFILING_TIMEOUT - 1) / PERIOD_PROFILING_CHECKPOINT)
+#define CKPT_RUN_WORDS (1 + CKPT_RUN_DELTAS * (1 + NUM_EVENTS) + 1)
+#if CKPT_RUN_WORDS > CKPT_WORDS
+#error Checkpoint segment too small for a run: FLASH_CHECKPOINT_SEGMENT_SIZE
+#endif
+
+#if NUM_EVENTS > 8
+#error Checkpoint delta mask too narrow for NUM_EVENTS
+#endif
+
+static uint16_t *ckpt_next; // next free word in the log
+
+// Counters as of the last checkpoint
+static profile_t ckpt_profile;
+
+static unsigned count_bits(uint16_t mask)
+{
+    unsigned n = 0;
+    while (mask) {
+        n += mask & 0x1;
+        mask >>= 1;
+    }
+    return n;
+}
+
+// Replays the log into prof (if not NULL), and returns whether the last run
+// is incomplete. Sets ckpt_next to the end of the log, or to NULL if the log
+// is corrupt.
+static bool replay(profile_t *prof)
+{
+    uint16_t *w = CKPT_ADDR;
+    bool open = false;
+
+    while (w < CKPT_ADDR + CKPT_WORDS) {
+        uint16_t word = *w;
+
+        if (word == CKPT_WORD_ERASED) {
+            break;
+        } else if (word == CKPT_WORD_START) {
+            if (prof)
+                memset(prof, 0, sizeof(profile_t));
+            open = true;
+            ++w;
+        } else if (word == CKPT_WORD_END) {
+            open = false;
+            ++w;
+        } else if ((word & CKPT_WORD_TYPE_MASK) == CKPT_WORD_DELTA) {
+            uint16_t mask = word & CKPT_DELTA_EVENTS_MASK;
+            ++w;
+            if (w + count_bits(mask) > CKPT_ADDR + CKPT_WORDS) {
+                LOG("CP: delta overruns log\r\n");
+                ckpt_next = NULL;
+                return false;
+            }
+            for (unsigned i = 0; i < NUM_EVENTS; ++i) {
+                if (mask & (1 << i)) {
+                    if (prof && !(word & CKPT_DELTA_UNCOMMITTED))
+                        memcpy(&prof->events[i], w, sizeof(event_t));
+                    ++w;
+                }
+            }
+        } else {
+            LOG("CP: invalid word in log: 0x%04x\r\n", word);
+            ckpt_next = NULL;
+            return false;
+        }
+    }
+
+    ckpt_next = w;
+    return open;
+}
+
+static void append(uint16_t word)
+{
+    flash_write_word(ckpt_next++, word);
+}
+
+static unsigned words_left()
+{
+    return CKPT_ADDR + CKPT_WORDS - ckpt_next;
+}
+
+static void restart_log()
+{
+    LOG("CP: erasing log\r\n");
+    flash_erase_segment((uint8_t *)CKPT_ADDR);
+    ckpt_next = CKPT_ADDR;
+    append(CKPT_WORD_START);
+}
+
+void checkpoint_open()
+{
+    memset(&ckpt_profile, 0, sizeof(profile_t));
+
+    replay(NULL);
+    // Erase now, with the bank full, if the run might not fit
+    if (!ckpt_next || words_left() < CKPT_RUN_WORDS)
+        restart_log();
+    else
+        append(CKPT_WORD_START);
+}
+
+void checkpoint_save(profile_t *prof)
+{
+    uint16_t mask = 0;
+    for (unsigned i = 0; i < NUM_EVENTS; ++i)
+        if (memcmp(&prof->events[i], &ckpt_profile.events[i], sizeof(event_t)))
+            mask |= 1 << i;
+
+    LOG("CP: checkpoint: mask 0x%02x\r\n", mask);
+    if (!mask)
+        return;
+
+    // Leave space for END. checkpoint_open() reserved the words of the run,
+    // so this is only a guard: skip rather than erase mid-run.
+    if (words_left() < 1 + count_bits(mask) + 1) {
+        LOG("CP: log full: checkpoint skipped\r\n");
+        return;
+    }
+
+    uint16_t *delta_addr = ckpt_next;
+    append(CKPT_WORD_DELTA | CKPT_DELTA_UNCOMMITTED | mask);
+    for (unsigned i = 0; i < NUM_EVENTS; ++i) {
+        if (mask & (1 << i)) {
+            uint16_t event_word;
+            memcpy(&event_word, &prof->events[i], sizeof(event_t));
+            append(event_word);
+        }
+    }
+    flash_write_word(delta_addr, CKPT_WORD_DELTA | mask); // commit
+
+    ckpt_profile = *prof;
+}
+
+void checkpoint_close()
+{
+    if (!ckpt_next || !words_left()) {
+        LOG("CP: no space to close log: erasing\r\n");
+        flash_erase_segment((uint8_t *)CKPT_ADDR);
+        return;
+    }
+    append(CKPT_WORD_END);
+}
+
+bool checkpoint_recover(profile_t *prof)
+{
+    if (!replay(prof)) {
+        if (!ckpt_next) // log is corrupt, nothing to recover
+            flash_erase_segment((uint8_t *)CKPT_ADDR);
+        return false;
+    }
+
+    for (unsigned i = 0; i < NUM_EVENTS; ++i)
+        if (prof->events[i].count)
+            return true;
+
+    LOG("CP: incomplete run has no data\r\n");
+    checkpoint_close();
+    return false;
+}
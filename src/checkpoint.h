@@ -0,0 +1,20 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+
+#include "profile.h"
+
+// Start a log for a new profiling run
+void checkpoint_open();
+// Append the counters that changed since the last checkpoint. prof is
+// written only by profile_pack(), in the main loop, as is this call.
+void checkpoint_save(profile_t *prof);
+// Mark the run as complete (profile was saved to the pkt store)
+void checkpoint_close();
+
+// Returns true if the last run was not completed, with its profile as of the
+// last checkpoint in 'prof'. Caller must checkpoint_close() once it is saved.
+bool checkpoint_recover(profile_t *prof);
+
+#endif // CHECKPOINT_H
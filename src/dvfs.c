@@ -0,0 +1,80 @@
+#include <msp430.h>
+#include <stdint.h>
+
+#include <libio/console.h>
+
+#include "dvfs.h"
+
+// Number of dvfs_boost() calls without a matching dvfs_unboost()
+static unsigned boost_depth;
+
+// Core voltage can only be changed one level at a time (see the PMM chapter
+// of the MSP430x5xx family user's guide)
+static void core_voltage_up(unsigned level)
+{
+    PMMCTL0_H = PMMPW_H; // unlock
+    // Set SVS/SVM high side to new level
+    SVSMHCTL = SVSHE | (SVSHRVL0 * level) | SVMHE | (SVSMHRRL0 * level);
+    // Set SVM low side to new level
+    SVSMLCTL = SVSLE | SVMLE | (SVSMLRRL0 * level);
+    while (!(PMMIFG & SVSMLDLYIFG));
+    PMMIFG &= ~(SVMLVLRIFG | SVMLIFG);
+    PMMCTL0_L = PMMCOREV0 * level;
+    // Wait until the new level is reached
+    if (PMMIFG & SVMLIFG)
+        while (!(PMMIFG & SVMLVLRIFG));
+    // Set SVS/SVM low side to new level
+    SVSMLCTL = SVSLE | (SVSLRVL0 * level) | SVMLE | (SVSMLRRL0 * level);
+    PMMCTL0_H = 0x00; // lock
+}
+
+static void core_voltage_down(unsigned level)
+{
+    PMMCTL0_H = PMMPW_H; // unlock
+    // Set SVS/SVM low side to new level
+    SVSMLCTL = SVSLE | (SVSLRVL0 * level) | SVMLE | (SVSMLRRL0 * level);
+    while (!(PMMIFG & SVSMLDLYIFG));
+    PMMIFG &= ~(SVMLVLRIFG | SVMLIFG);
+    PMMCTL0_L = PMMCOREV0 * level;
+    PMMCTL0_H = 0x00; // lock
+}
+
+static void set_core_voltage(unsigned level)
+{
+    unsigned cur = PMMCTL0 & PMMCOREV_3;
+    while (cur < level)
+        core_voltage_up(++cur);
+    while (cur > level)
+        core_voltage_down(--cur);
+}
+
+static void clock_low()
+{
+    UCSCTL5 = (UCSCTL5 & ~DIVM_7) | DVFS_LOW_DIVM; // MCLK only
+    set_core_voltage(DVFS_LOW_CORE_VOLTAGE_LEVEL);
+}
+
+static void clock_full()
+{
+    // Raise voltage before frequency
+    set_core_voltage(DVFS_FULL_CORE_VOLTAGE_LEVEL); // as set by msp_clock_setup()
+    UCSCTL5 = (UCSCTL5 & ~DIVM_7) | DIVM__1;
+}
+
+void dvfs_init()
+{
+    boost_depth = 0;
+    clock_low();
+}
+
+void dvfs_boost()
+{
+    if (boost_depth++ == 0)
+        clock_full();
+}
+
+void dvfs_unboost()
+{
+    if (--boost_depth == 0)
+        clock_low();
+}
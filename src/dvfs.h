@@ -0,0 +1,25 @@
+#ifndef DVFS_H
+#define DVFS_H
+
+// Runs the CPU at a lower clock and core voltage, except around operations
+// that are timing-critical (radio) or that block with interrupts disabled
+// (flash programming). Only MCLK is scaled: SMCLK and ACLK, and so the
+// softuart console and uartlink baud timing, stay as set up by libmsp.
+
+#ifdef CONFIG_CLOCK_SCALING
+
+// Switch to the low clock, call after msp_clock_setup()
+void dvfs_init();
+
+// Run at full clock until the matching unboost (calls nest)
+void dvfs_boost();
+void dvfs_unboost();
+
+#else // !CONFIG_CLOCK_SCALING
+
+static inline void dvfs_boost() {}
+static inline void dvfs_unboost() {}
+
+#endif // !CONFIG_CLOCK_SCALING
+
+#endif // DVFS_H
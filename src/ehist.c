@@ -0,0 +1,44 @@
+#include <msp430.h>
+
+#include <libio/console.h>
+
+#include "ehist.h"
+#include "flash.h"
+
+// The segment holds a log of estimates, one per run, and the last one is
+// current. Erased when full, so one erase every segment's worth of runs.
+#define EHIST_WORD_ERASED 0xFFFF // never a valid estimate (see EHIST_EDGE_MAX)
+
+#define EHIST_ADDR  ((uint16_t *)FLASH_EHIST_SEGMENT)
+#define EHIST_WORDS (FLASH_EHIST_SEGMENT_SIZE / 2)
+
+static uint16_t *find_free_word()
+{
+    uint16_t *w = EHIST_ADDR;
+    while (w < EHIST_ADDR + EHIST_WORDS && *w != EHIST_WORD_ERASED)
+        ++w;
+    return w;
+}
+
+uint16_t ehist_edge_load()
+{
+    uint16_t *w = find_free_word();
+    if (w == EHIST_ADDR)
+        return PROFILING_EHIST_BIN_EDGE_0 << EHIST_EDGE_FRAC_BITS;
+    return *(w - 1);
+}
+
+void ehist_edge_save(uint16_t edge)
+{
+    uint16_t *w = find_free_word();
+    if (w > EHIST_ADDR && *(w - 1) == edge)
+        return; // unchanged, save a write
+
+    LOG("EH: save edge 0x%04x\r\n", edge);
+
+    if (w == EHIST_ADDR + EHIST_WORDS) {
+        flash_erase_segment((uint8_t *)EHIST_ADDR);
+        w = EHIST_ADDR;
+    }
+    flash_write_word(w, edge);
+}
@@ -0,0 +1,18 @@
+#ifndef EHIST_H
+#define EHIST_H
+
+#include <stdint.h>
+
+// Estimate of the energy histogram bin edge: ADC code in fixed point 12.4
+#define EHIST_EDGE_FRAC_BITS 4
+#define EHIST_EDGE_MAX       (0x0FFF << EHIST_EDGE_FRAC_BITS)
+
+// Bin edge sent in the profile pkt: top 8 bits of the ADC code
+#define EHIST_EDGE_TO_BYTE(e)  ((uint8_t)((e) >> 8))
+#define EHIST_EDGE_FROM_BYTE(b) ((uint16_t)(b) << 8)
+
+// Returns the estimate saved by the last run, or the configured edge
+uint16_t ehist_edge_load();
+void ehist_edge_save(uint16_t edge);
+
+#endif // EHIST_H
@@ -9,6 +9,7 @@
 
 #include "flash.h"
 #include "bits.h"
+#include "dvfs.h"
 
 // Number of words reserved for the free-block bitmask
 #define FREE_MASK_WORDS 7
@@ -19,6 +20,21 @@
 #define FREE_MASK_ADDR  ((uint8_t *)FLASH_STORAGE_SEGMENT) /* don't use A, since it's locked by default */
 #define STORE_ADDR (FREE_MASK_ADDR + FREE_MASK_WORDS * 2)
 
+// LOCKA is set on reset and toggles when written with 1, so writing FCTL3
+// with it clear leaves segment A (FLASH_ACCUM_SEGMENT) locked. Returns
+// LOCKA as it was, to be set back by lock().
+static uint16_t unlock()
+{
+    uint16_t locka = FCTL3 & LOCKA;
+    FCTL3 = FWPW | locka; // clear LOCK, and toggle LOCKA clear if set
+    return locka;
+}
+
+static void lock(uint16_t locka)
+{
+    FCTL3 = FWPW | LOCK | locka; // toggle LOCKA back if it was set
+}
+
 static void print_mask()
 {
     LOG("FM: mask: ");
@@ -33,6 +49,16 @@ bool flash_addr_in_range(uint8_t *addr)
     return FREE_MASK_ADDR <= addr && addr < FREE_MASK_ADDR + FLASH_STORAGE_SEGMENT_SIZE;
 }
 
+uint8_t *flash_store_addr()
+{
+    return STORE_ADDR;
+}
+
+unsigned flash_store_size()
+{
+    return FREE_MASK_WORDS * 16; // one bit in the free mask per byte
+}
+
 static unsigned find_first_set_word_in_mask()
 {
     uint16_t *addr = (uint16_t *)FREE_MASK_ADDR;
@@ -147,19 +173,21 @@ bool flash_write_byte(uint8_t *addr, uint8_t byte)
 {
     LOG("FM: write byte: 0x%04x <- 0x%02x\r\n", (uint16_t)addr, byte);
 
+    dvfs_boost();
     __disable_interrupt();
     msp_watchdog_hold();
 
-    FCTL3 = FWPW; // clear LOCK (and LOCKA)
+    uint16_t locka = unlock();
     FCTL1 = FWPW | WRT; // word/byte write
 
     *addr = byte;
 
     FCTL1 = FWPW; // clear write
-    FCTL3 = FWPW | LOCK; // lock
+    lock(locka);
 
     msp_watchdog_release();
     __enable_interrupt();
+    dvfs_unboost();
 
     if (FCTL3 & ACCVIFG) {
         LOG("FM: write error\r\n");
@@ -174,19 +202,21 @@ bool flash_write_word(uint16_t *addr, uint16_t word)
 {
     LOG("FM: write word: 0x%04x <- 0x%04x\r\n", (uint16_t)addr, word);
 
+    dvfs_boost();
     __disable_interrupt();
     msp_watchdog_hold();
 
-    FCTL3 = FWPW; // clear LOCK (and LOCKA)
+    uint16_t locka = unlock();
     FCTL1 = FWPW | WRT; // word/byte write
 
     *addr = word;
 
     FCTL1 = FWPW; // clear write
-    FCTL3 = FWPW | LOCK; // lock
+    lock(locka);
 
     msp_watchdog_release();
     __enable_interrupt();
+    dvfs_unboost();
 
     if (FCTL3 & ACCVIFG) {
         LOG("FM: write error\r\n");
@@ -201,10 +231,11 @@ bool flash_write_long(uint16_t *addr, uint16_t hi, uint16_t lo)
 {
     LOG("FM: write long: 0x%04x <- 0x%04x%04x\r\n", (uint16_t)addr, hi, lo);
 
+    dvfs_boost();
     __disable_interrupt();
     msp_watchdog_hold();
 
-    FCTL3 = FWPW; // clear LOCK (and LOCKA)
+    uint16_t locka = unlock();
     FCTL1 = FWPW | BLKWRT; // long write
 
     // *addr = longword, both of uint32_t, does not work, even though it does
@@ -214,10 +245,11 @@ bool flash_write_long(uint16_t *addr, uint16_t hi, uint16_t lo)
     *addr = lo;
 
     FCTL1 = FWPW; // clear write
-    FCTL3 = FWPW | LOCK; // lock
+    lock(locka);
 
     msp_watchdog_release();
     __enable_interrupt();
+    dvfs_unboost();
 
     if (FCTL3 & ACCVIFG) {
         LOG("FM: write error\r\n");
@@ -240,6 +272,7 @@ bool flash_write(uint8_t *dest, uint8_t *data, unsigned len)
 
     bool success = true;
 
+    dvfs_boost();
     __disable_interrupt();
     msp_watchdog_hold();
 
@@ -248,11 +281,11 @@ bool flash_write(uint8_t *dest, uint8_t *data, unsigned len)
     if (len > 0 && (uint16_t)dest & 0x1) {
         uint8_t b = *data;
 
-        FCTL3 = FWPW; // clear LOCK (and LOCKA)
+        uint16_t locka = unlock();
         FCTL1 = FWPW | WRT; // byte write
         *dest = b;
         FCTL1 = FWPW; // clear write
-        FCTL3 = FWPW | LOCK; // lock
+        lock(locka);
 
         if (FCTL3 & ACCVIFG) {
             success = false;
@@ -270,11 +303,11 @@ bool flash_write(uint8_t *dest, uint8_t *data, unsigned len)
     while (len >= 2) {
         uint16_t w = *data_w;
 
-        FCTL3 = FWPW; // clear LOCK (and LOCKA)
+        uint16_t locka = unlock();
         FCTL1 = FWPW | WRT; // word write
         *dest_w = w;
         FCTL1 = FWPW; // clear write
-        FCTL3 = FWPW | LOCK; // lock
+        lock(locka);
 
         if (FCTL3 & ACCVIFG) {
             success = false;
@@ -292,11 +325,11 @@ bool flash_write(uint8_t *dest, uint8_t *data, unsigned len)
 
         uint8_t b = *data;
 
-        FCTL3 = FWPW; // clear LOCK (and LOCKA)
+        uint16_t locka = unlock();
         FCTL1 = FWPW | WRT; // byte write
         *dest = b;
         FCTL1 = FWPW; // clear write
-        FCTL3 = FWPW | LOCK; // lock
+        lock(locka);
 
         if (FCTL3 & ACCVIFG) {
             success = false;
@@ -308,6 +341,7 @@ exit:
 
     msp_watchdog_release();
     __enable_interrupt();
+    dvfs_unboost();
 
     if (success)
         LOG("FM: write completed\r\n");
@@ -319,19 +353,26 @@ exit:
 
 bool flash_erase()
 {
-    LOG("FM: erasing seg at 0x%04x\r\n", (uint16_t)FREE_MASK_ADDR);
+    return flash_erase_segment(FREE_MASK_ADDR);
+}
+
+bool flash_erase_segment(uint8_t *addr)
+{
+    LOG("FM: erasing seg at 0x%04x\r\n", (uint16_t)addr);
 
+    dvfs_boost();
     __disable_interrupt();
     msp_watchdog_hold();
 
-    FCTL3 = FWPW; // clear LOCK (and LOCKA)
+    uint16_t locka = unlock();
     FCTL1 = FWPW | ERASE; // segment erase mode
-    *FREE_MASK_ADDR = 0; // dummy write to trigger erase
+    *addr = 0; // dummy write to trigger erase
     while (FCTL3 & BUSY);
-    FCTL3 = FWPW | LOCK;
+    lock(locka);
 
     msp_watchdog_release();
     __enable_interrupt();
+    dvfs_unboost();
 
     if (FCTL3 & ACCVIFG) {
         LOG("FM: erase failed\r\n");
@@ -13,9 +13,12 @@ typedef enum {
     FLASH_STATUS_OK = 0,
     FLASH_STATUS_ALLOC_FAILED = 1,
     FLASH_STATUS_WRITE_FAILED = 2,
+    FLASH_STATUS_LOW_ENERGY = 3,
 } flash_status_t;
 
 bool flash_addr_in_range(uint8_t *addr);
+uint8_t *flash_store_addr();
+unsigned flash_store_size();
 
 unsigned flash_find_space(unsigned len, flash_loc_t *loc);
 uint8_t *flash_alloc(flash_loc_t *loc, unsigned len);
@@ -27,5 +30,6 @@ bool flash_write_long(uint16_t *addr, uint16_t hi, uint16_t lo);
 bool flash_write(uint8_t *dest, uint8_t *data, unsigned len);
 
 bool flash_erase();
+bool flash_erase_segment(uint8_t *addr);
 
 #endif // FLASH_H
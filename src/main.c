@@ -13,6 +13,28 @@
 #include "payload.h"
 #include "flash.h"
 #include "random.h"
+#include "dvfs.h"
+
+#ifdef CONFIG_PROFILE_CHECKPOINT
+#include "checkpoint.h"
+#endif // CONFIG_PROFILE_CHECKPOINT
+
+#ifdef CONFIG_PROFILE_ACCUMULATE
+#include "accum.h"
+#endif // CONFIG_PROFILE_ACCUMULATE
+
+#ifdef CONFIG_ENERGY_BUDGET
+#include "budget.h"
+#include "power.h"
+#endif // CONFIG_ENERGY_BUDGET
+
+#ifdef CONFIG_BOOT_TIMING
+#include "boottime.h"
+#endif // CONFIG_BOOT_TIMING
+
+#ifdef CONFIG_FAST_BOOT
+#include "power.h"
+#endif // CONFIG_FAST_BOOT
 
 #define CONFIG_WDT_BITS WATCHDOG_BITS(WATCHDOG_CLOCK, WATCHDOG_INTERVAL)
 
@@ -29,6 +51,26 @@ typedef enum {
 uint8_t app_data[MAX_APP_DATA_LEN];
 unsigned app_data_len = 0;
 
+#ifdef CONFIG_COLLECT_ENERGY_PROFILE
+// Profile pkt saved after a run: with CONFIG_PROFILE_ACCUMULATE, the sum,
+// which is saved after some runs only, but space is kept for it on every run
+#ifdef CONFIG_PROFILE_ACCUMULATE
+#define PROFILE_RUN_PKT_SIZE PROFILE_SUM_PKT_SIZE
+#else // !CONFIG_PROFILE_ACCUMULATE
+#define PROFILE_RUN_PKT_SIZE PROFILE_PKT_MAX_SIZE
+#endif // !CONFIG_PROFILE_ACCUMULATE
+
+// Flash space needed by the pkts saved after a profiling run
+#ifdef CONFIG_PROFILE_TRANSITIONS
+#define PROFILE_RUN_FLASH_SPACE (PROFILE_RUN_PKT_SIZE + PAYLOAD_DESC_SIZE + \
+                                 TRANSITIONS_PKT_SIZE + PAYLOAD_DESC_SIZE + \
+                                 MAX_APP_DATA_LEN + PAYLOAD_DESC_SIZE)
+#else // !CONFIG_PROFILE_TRANSITIONS
+#define PROFILE_RUN_FLASH_SPACE (PROFILE_RUN_PKT_SIZE + PAYLOAD_DESC_SIZE + \
+                                 MAX_APP_DATA_LEN + PAYLOAD_DESC_SIZE)
+#endif // !CONFIG_PROFILE_TRANSITIONS
+#endif // CONFIG_COLLECT_ENERGY_PROFILE
+
 static void handle_flash_op_outcome(unsigned rc) {
     switch (rc) {
         case FLASH_STATUS_ALLOC_FAILED:
@@ -46,8 +88,153 @@ static void handle_flash_op_outcome(unsigned rc) {
     }
 }
 
+// Make room in flash for 'len' bytes, and reboot, since erasing takes energy
+static void free_flash_space(unsigned len)
+{
+#ifdef CONFIG_PKT_QUEUES
+    unsigned evicted;
+    switch (pkt_store_evict(len, &evicted)) {
+        case FLASH_STATUS_OK:
+            LOG("evicted %u pkts from flash\r\n", evicted);
+            capybara_shutdown();
+            break;
+        case FLASH_STATUS_LOW_ENERGY: // try again once charged
+            capybara_shutdown();
+            break;
+        default:
+            break;
+    }
+#endif // CONFIG_PKT_QUEUES
+    flash_erase();
+    capybara_shutdown();
+}
+
+#ifdef CONFIG_ENERGY_BUDGET
+static void save_budget(unsigned flags)
+{
+    if (!budget_due())
+        return;
+
+    uint8_t pkt[BUDGET_PKT_SIZE] __attribute__((aligned(2)));
+    unsigned len = budget_to_pkt(pkt, &budget, flags);
+
+    flash_loc_t loc;
+    unsigned free_space = flash_find_space(len + PAYLOAD_DESC_SIZE, &loc);
+    if (free_space < len + PAYLOAD_DESC_SIZE) {
+        LOG("insufficient flash space for energy budget: skipping\r\n"); // not worth an erase
+        return;
+    }
+
+    LOG("saving energy budget to flash\r\n");
+    flash_status_t rc = save_payload(&loc, PKT_TYPE_ENERGY_PROFILE, pkt, len);
+    handle_flash_op_outcome(rc);
+}
+
+// After a transmission, save only if there is energy left for the flash
+// writes: a brownout in the middle would leave an invalid pkt in the store
+static void save_budget_after_transmit()
+{
+    budget_mark(BUDGET_PHASE_TRANSMIT);
+    if (sense_vbank() >= BUDGET_VBANK_SAVE_MIN)
+        save_budget(PKT_FLAG_BUDGET_SENT);
+}
+#endif // CONFIG_ENERGY_BUDGET
+
+#ifdef CONFIG_BOOT_TIMING
+// Without a console, save the durations as a pkt, if there is space
+static void report_boot_timing()
+{
+#ifdef CONFIG_FAST_BOOT
+    if (!boot_timing_due())
+        return;
+
+    uint8_t pkt[BOOT_TIMING_PKT_SIZE] __attribute__((aligned(2)));
+    unsigned len = boot_timing_to_pkt(pkt, &boot_timing, PKT_FLAG_BOOT_TIMING_FAST);
+
+    flash_loc_t loc;
+    unsigned free_space = flash_find_space(len + PAYLOAD_DESC_SIZE, &loc);
+    if (free_space < len + PAYLOAD_DESC_SIZE)
+        return; // not worth an erase
+
+    flash_status_t rc = save_payload(&loc, PKT_TYPE_ENERGY_PROFILE, pkt, len);
+    handle_flash_op_outcome(rc);
+#else // !CONFIG_FAST_BOOT
+    boot_timing_log();
+#endif // !CONFIG_FAST_BOOT
+}
+#endif // CONFIG_BOOT_TIMING
+
+#ifdef CONFIG_PROFILE_ACCUMULATE
+// Add the profile to the sum in flash, and save the sum as a pkt when it is
+// due. Space for the pkt at 'loc' must have been checked.
+static void accumulate_profile(flash_loc_t *loc, bool partial, profile_stop_t stop)
+{
+    bool due = accum_add(&profile, partial, stop);
+
+#ifdef CONFIG_PROFILE_CHECKPOINT
+    checkpoint_close(); // profile is safe in the sum
+#endif // CONFIG_PROFILE_CHECKPOINT
+
+    if (!due)
+        return;
+
+    LOG("saving sum of %u profiles to flash\r\n", profile_sum.runs);
+    uint8_t pkt[PROFILE_SUM_PKT_SIZE] __attribute__((aligned(2)));
+    unsigned len = profile_sum_to_pkt(pkt, &profile_sum, profile_sum_flags);
+    flash_status_t rc = save_profile_payload(loc, pkt, len, stop);
+    handle_flash_op_outcome(rc);
+
+    accum_reset();
+}
+#endif // CONFIG_PROFILE_ACCUMULATE
+
+#ifdef CONFIG_PROFILE_CHECKPOINT
+// If the previous profiling run browned out, save what it collected
+static void recover_partial_profile()
+{
+    if (!checkpoint_recover(&profile))
+        return;
+
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+    restore_ehist_edge(); // not yet updated by the interrupted run
+#endif // CONFIG_PROFILE_ADAPTIVE_BINS
+
+    LOG("recovered partial profile from checkpoint\r\n");
+
+#ifdef CONFIG_PROFILE_ACCUMULATE
+    flash_loc_t loc;
+    unsigned free_space = flash_find_space(PROFILE_SUM_PKT_SIZE + PAYLOAD_DESC_SIZE, &loc);
+    if (free_space < PROFILE_SUM_PKT_SIZE + PAYLOAD_DESC_SIZE) {
+        LOG("insufficient flash space for sum of profiles\r\n");
+        free_flash_space(PROFILE_SUM_PKT_SIZE + PAYLOAD_DESC_SIZE); // checkpoint stays open
+    }
+
+    accumulate_profile(&loc, /* partial */ true, PROFILE_STOP_UNKNOWN);
+#else // !CONFIG_PROFILE_ACCUMULATE
+    uint8_t pkt[PROFILE_PKT_MAX_SIZE] __attribute__((aligned(2)));
+    unsigned len = profile_to_pkt(pkt, &profile, PKT_FLAG_PROFILE_PARTIAL);
+
+    flash_loc_t loc;
+    unsigned free_space = flash_find_space(len + PAYLOAD_DESC_SIZE, &loc);
+    if (free_space < len + PAYLOAD_DESC_SIZE) {
+        LOG("insufficient flash space for partial profile\r\n");
+        free_flash_space(len + PAYLOAD_DESC_SIZE); // checkpoint stays open, recover on next boot
+    }
+
+    flash_status_t rc = save_payload(&loc, PKT_TYPE_ENERGY_PROFILE, pkt, len);
+    handle_flash_op_outcome(rc);
+
+    checkpoint_close();
+#endif // !CONFIG_PROFILE_ACCUMULATE
+}
+#endif // CONFIG_PROFILE_CHECKPOINT
+
 int main(void)
 {
+#ifdef CONFIG_BOOT_TIMING
+    boot_timing_start();
+#endif // CONFIG_BOOT_TIMING
+
 #ifdef CONFIG_WATCHDOG
 	msp_watchdog_enable(CONFIG_WDT_BITS);
 #else // !CONFIG_WATCHDOG
@@ -66,31 +253,93 @@ int main(void)
 
     capybara_config_pins();
 
+#ifdef CONFIG_ENERGY_BUDGET
+    budget_start();
+#endif // CONFIG_ENERGY_BUDGET
+
     __enable_interrupt();
 
     capybara_wait_for_supply();
+#ifdef CONFIG_BOOT_TIMING
+    boot_timing_mark(BOOT_PHASE_SUPPLY);
+#endif // CONFIG_BOOT_TIMING
 
     msp_clock_setup(); // set up unified clock system
+#ifdef CONFIG_CLOCK_SCALING
+    dvfs_init();
+#endif // CONFIG_CLOCK_SCALING
+#ifdef CONFIG_BOOT_TIMING
+    boot_timing_mark(BOOT_PHASE_CLOCK);
+#endif // CONFIG_BOOT_TIMING
+
+#ifndef CONFIG_FAST_BOOT
     INIT_CONSOLE();
 
     LOG("EDBsat v1.2 - EDB MCU\r\n");
+#ifdef CONFIG_BOOT_TIMING
+    boot_timing_mark(BOOT_PHASE_CONSOLE);
+#endif // CONFIG_BOOT_TIMING
+#endif // !CONFIG_FAST_BOOT
 
 #ifdef CONFIG_SEED_RNG_FROM_VCAP
+#ifdef CONFIG_FAST_BOOT
+    seed_random(sense_vbank()); // same ADC setup as later Vbank samples
+#else // !CONFIG_FAST_BOOT
     seed_random_from_adc();
+#endif // !CONFIG_FAST_BOOT
 #endif // CONFIG_SEED_RNG_FROM_VCAP
-
-    // Randomly choose which action to perform: P=1/4
-    task_t task = ((rand() & 0x3) == 0) ? TASK_BEACON : TASK_ENERGY_PROFILE;
+#ifdef CONFIG_BOOT_TIMING
+    boot_timing_mark(BOOT_PHASE_SEED);
+#endif // CONFIG_BOOT_TIMING
+
+#ifndef CONFIG_FAST_BOOT // deferred to the profiling task
+#if defined(CONFIG_PROFILE_APPROX_COUNTS) || defined(CONFIG_PROFILE_DUTY_CYCLE)
+    seed_random_fast();
+#endif // CONFIG_PROFILE_APPROX_COUNTS || CONFIG_PROFILE_DUTY_CYCLE
+
+#ifdef CONFIG_PROFILE_CHECKPOINT
+    recover_partial_profile();
+#endif // CONFIG_PROFILE_CHECKPOINT
+#endif // !CONFIG_FAST_BOOT
+
+    // Randomly choose which action to perform: P(beacon)=1/2^N
+    task_t task = ((rand() & ((1 << BEACON_PROBABILITY_LOG2) - 1)) == 0) ?
+                        TASK_BEACON : TASK_ENERGY_PROFILE;
     LOG("task: %u\r\n", task);
 
+#ifdef CONFIG_BOOT_TIMING
+    boot_timing_mark(BOOT_PHASE_INIT);
+    report_boot_timing();
+#endif // CONFIG_BOOT_TIMING
+
+#ifdef CONFIG_ENERGY_BUDGET
+    budget_mark(BUDGET_PHASE_BOOT);
+#endif // CONFIG_ENERGY_BUDGET
+
     switch (task) {
         case TASK_BEACON:
             payload_send_beacon();
+#ifdef CONFIG_ENERGY_BUDGET
+            save_budget_after_transmit();
+#endif // CONFIG_ENERGY_BUDGET
             break;
 #ifdef CONFIG_COLLECT_ENERGY_PROFILE
         case TASK_ENERGY_PROFILE:
 
+#ifdef CONFIG_FAST_BOOT
+#if defined(CONFIG_PROFILE_APPROX_COUNTS) || defined(CONFIG_PROFILE_DUTY_CYCLE)
+            seed_random_fast();
+#endif // CONFIG_PROFILE_APPROX_COUNTS || CONFIG_PROFILE_DUTY_CYCLE
+
+#ifdef CONFIG_PROFILE_CHECKPOINT
+            recover_partial_profile();
+#endif // CONFIG_PROFILE_CHECKPOINT
+#endif // CONFIG_FAST_BOOT
+
             if (transmit_saved_payload()) {
+#ifdef CONFIG_ENERGY_BUDGET
+                save_budget_after_transmit();
+#endif // CONFIG_ENERGY_BUDGET
                 LOG("saved pkt transmitted: shutting down\r\n");
                 capybara_shutdown(); // we're out of energy after any transmission
             } else {
@@ -98,16 +347,18 @@ int main(void)
                 // move on, collect some data
             }
 
+#ifdef CONFIG_ENERGY_BUDGET
+            budget_mark(BUDGET_PHASE_TRANSMIT); // lookup only
+#endif // CONFIG_ENERGY_BUDGET
+
             LOG("collect profile: isolate and turn on app supply\r\n");
 
             flash_loc_t loc;
-            unsigned free_space = flash_find_space(PROFILE_SIZE + PAYLOAD_DESC_SIZE, &loc);
-            LOG("free space in flash: %u (need %u)\r\n", free_space,
-                PROFILE_SIZE + PAYLOAD_DESC_SIZE + MAX_APP_DATA_LEN + PAYLOAD_DESC_SIZE);
-            if (free_space < PROFILE_SIZE + PAYLOAD_DESC_SIZE + MAX_APP_DATA_LEN + PAYLOAD_DESC_SIZE) {
+            unsigned free_space = flash_find_space(PROFILE_RUN_PKT_SIZE + PAYLOAD_DESC_SIZE, &loc);
+            LOG("free space in flash: %u (need %u)\r\n", free_space, PROFILE_RUN_FLASH_SPACE);
+            if (free_space < PROFILE_RUN_FLASH_SPACE) {
                 LOG("insufficient flash space for profile and app data\r\n");
-                flash_erase();
-                capybara_shutdown();
+                free_flash_space(PROFILE_RUN_FLASH_SPACE);
             }
 
             uartlink_open_rx();
@@ -144,15 +395,42 @@ int main(void)
 
             stop_profiling();
 
+#ifdef CONFIG_ENERGY_BUDGET
+            budget_mark(BUDGET_PHASE_PROFILE);
+#endif // CONFIG_ENERGY_BUDGET
+
             LOG("turn off app supply and reconnect harvester\r\n");
             GPIO(PORT_APP_SW, OUT) &= ~BIT(PIN_APP_SW);
             GPIO(PORT_ISOL_EN, OUT) &= ~BIT(PIN_ISOL_EN);
 
             uartlink_close();
 
+#ifdef CONFIG_PROFILE_ACCUMULATE
+            LOG("adding profile to sum in flash\r\n");
+            accumulate_profile(&loc, /* partial */ false, profile_stop_reason());
+#else // !CONFIG_PROFILE_ACCUMULATE
             LOG("saving profile to flash\r\n");
-            flash_status_t rc = save_payload(&loc, PKT_TYPE_ENERGY_PROFILE, (uint8_t *)&profile, PROFILE_SIZE);
+            uint8_t profile_pkt[PROFILE_PKT_MAX_SIZE] __attribute__((aligned(2)));
+            unsigned profile_pkt_len = profile_to_pkt(profile_pkt, &profile, 0);
+            handle_flash_op_outcome(save_profile_payload(&loc, profile_pkt, profile_pkt_len,
+                                                         profile_stop_reason()));
+#endif // !CONFIG_PROFILE_ACCUMULATE
+
+#ifdef CONFIG_PROFILE_TRANSITIONS
+            LOG("saving transitions to flash\r\n");
+            uint8_t transitions_pkt[TRANSITIONS_PKT_SIZE] __attribute__((aligned(2)));
+            unsigned transitions_pkt_len = transitions_to_pkt(transitions_pkt, &profile_transitions);
+            flash_status_t rc = save_payload(&loc, PKT_TYPE_ENERGY_PROFILE, transitions_pkt, transitions_pkt_len);
             handle_flash_op_outcome(rc);
+#endif // CONFIG_PROFILE_TRANSITIONS
+
+#if defined(CONFIG_PROFILE_CHECKPOINT) && !defined(CONFIG_PROFILE_ACCUMULATE)
+            checkpoint_close(); // profile is safe in the pkt store
+#endif // CONFIG_PROFILE_CHECKPOINT && !CONFIG_PROFILE_ACCUMULATE
+
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+            save_ehist_edge(); // after the profile, since it is sent with the old edge
+#endif // CONFIG_PROFILE_ADAPTIVE_BINS
 
             if (app_data_len) { // we know there is space, because we checked above; loc was updated
                 LOG("saving app data to flash\r\n");
@@ -162,6 +440,11 @@ int main(void)
                 LOG("no app data was received\r\n");
             }
 
+#ifdef CONFIG_ENERGY_BUDGET
+            budget_mark(BUDGET_PHASE_SAVE);
+            save_budget(/* flags */ 0);
+#endif // CONFIG_ENERGY_BUDGET
+
             break;
 #endif // CONFIG_COLLECT_ENERGY_PROFILE
 
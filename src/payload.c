@@ -18,18 +18,32 @@
 #include "payload.h"
 #include "flash.h"
 #include "bits.h"
+#include "dvfs.h"
+
+#if defined(CONFIG_BEACON_STATUS) || defined(CONFIG_PKT_QUEUES)
+#include "power.h"
+#endif
+
+#ifdef CONFIG_BEACON_STATUS
+static void collect_beacon_status(beacon_status_union_t *status);
+#endif // CONFIG_BEACON_STATUS
 
 void payload_send_beacon()
 {
-    uint8_t pkt = BEACON;
+    beacon_pkt_t pkt = { .beacon = BEACON };
+#ifdef CONFIG_BEACON_STATUS
+    collect_beacon_status(&pkt.status);
+#endif // CONFIG_BEACON_STATUS
 
-    LOG("transmitting beacon: 0x%02x\r\n", pkt);
+    LOG("transmitting beacon: 0x%02x (len %u)\r\n", pkt.beacon, sizeof(pkt));
 
 #ifdef CONFIG_RADIO_TRANSMIT_PAYLOAD
+    dvfs_boost(); // radio timing assumes LIBSPRITE_CLOCK_FREQ
     SpriteRadio_SpriteRadio(); // only one tx per boot, so init here
     SpriteRadio_txInit();
     SpriteRadio_transmit((char *)&pkt, sizeof(pkt));
     SpriteRadio_sleep();
+    dvfs_unboost();
 #endif
 }
 
@@ -45,24 +59,177 @@ bool payload_send_pkt(rad_pkt_union_t *pkt)
         pkt_raw, chksum, pkt->typed.chksum, pkt->raw);
 
 #ifdef CONFIG_RADIO_TRANSMIT_PAYLOAD
+    dvfs_boost(); // radio timing assumes LIBSPRITE_CLOCK_FREQ
     SpriteRadio_SpriteRadio(); // only one tx per boot, so init here
     SpriteRadio_txInit();
     SpriteRadio_transmit((char *)pkt, sizeof(rad_pkt_t));
     SpriteRadio_sleep();
+    dvfs_unboost();
 #endif // CONFIG_RADIO_TRANSMIT_PAYLOAD
 
     LOG("tx done\r\n");
     return true;
 }
 
+#ifdef CONFIG_COLLECT_ENERGY_PROFILE
+#ifdef CONFIG_PROFILE_PROGRESSIVE
+static void put_bit(uint8_t *buf, unsigned pos, unsigned bit)
+{
+    if (bit & 0x1)
+        buf[pos >> 3] |= 1 << (pos & 0x7);
+}
+
+// Most significant bits first, across counters (see payload.h)
+static void profile_to_planes(uint8_t *buf, const profile_t *prof)
+{
+    memset(buf, 0, PROFILE_SIZE);
+    unsigned pos = 0;
+    for (int k = PROFILE_COUNT_BITS - 1; k >= 0; --k) {
+        for (int i = 0; i < NUM_EVENTS; ++i) {
+            const event_t *event = &prof->events[i];
+            put_bit(buf, pos++, event->count >> k);
+            if (k < PROFILE_EHIST_BIN_BITS) {
+                put_bit(buf, pos++, event->ehist_bin0 >> k);
+                put_bit(buf, pos++, event->ehist_bin1 >> k);
+            }
+        }
+    }
+}
+#endif // CONFIG_PROFILE_PROGRESSIVE
+
+unsigned profile_to_pkt(uint8_t *pkt, const profile_t *prof, unsigned flags)
+{
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+    flags |= PKT_FLAG_PROFILE_EDGES;
+#endif // CONFIG_PROFILE_ADAPTIVE_BINS
+#ifdef CONFIG_PROFILE_APPROX_COUNTS
+    flags |= PKT_FLAG_PROFILE_APPROX;
+#endif // CONFIG_PROFILE_APPROX_COUNTS
+
+#ifdef CONFIG_PROFILE_PROGRESSIVE
+    unsigned len = 0;
+    pkt_tag_union_t tag = { .typed = { .kind = PKT_KIND_PROFILE_PROGRESSIVE, .flags = flags } };
+    pkt[len++] = tag.raw;
+    profile_to_planes(pkt + len, prof);
+    len += PROFILE_SIZE;
+#else // !CONFIG_PROFILE_PROGRESSIVE
+#ifndef CONFIG_PROFILE_DUTY_CYCLE // the duty cycle byte needs the tag
+    if (!flags) { // plain profile, for compatibility with existing decoders
+        memcpy(pkt, prof, PROFILE_SIZE);
+        return PROFILE_SIZE;
+    }
+#endif // !CONFIG_PROFILE_DUTY_CYCLE
+
+    unsigned len = 0;
+    pkt_tag_union_t tag = { .typed = { .kind = PKT_KIND_PROFILE, .flags = flags } };
+    pkt[len++] = tag.raw;
+    memcpy(pkt + len, prof, PROFILE_SIZE);
+    len += PROFILE_SIZE;
+#endif // !CONFIG_PROFILE_PROGRESSIVE
+
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+    pkt[len++] = profile_ehist_edge;
+#endif // CONFIG_PROFILE_ADAPTIVE_BINS
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+    pkt[len++] = profile_duty_cycle;
+#endif // CONFIG_PROFILE_DUTY_CYCLE
+
+    return len;
+}
+
+#ifdef CONFIG_PROFILE_ACCUMULATE
+unsigned profile_sum_to_pkt(uint8_t *pkt, const profile_sum_t *sum, unsigned flags)
+{
+    unsigned len = 0;
+    pkt_tag_union_t tag = { .typed = { .kind = PKT_KIND_PROFILE_SUM, .flags = flags } };
+    pkt[len++] = tag.raw;
+    memcpy(pkt + len, sum, sizeof(profile_sum_t));
+    len += sizeof(profile_sum_t);
+    return len;
+}
+#endif // CONFIG_PROFILE_ACCUMULATE
+
+#ifdef CONFIG_PROFILE_TRANSITIONS
+unsigned transitions_to_pkt(uint8_t *pkt, const profile_transitions_t *trans)
+{
+    unsigned flags = 0;
+#ifdef CONFIG_PROFILE_APPROX_COUNTS
+    flags |= PKT_FLAG_TRANSITIONS_APPROX;
+#endif // CONFIG_PROFILE_APPROX_COUNTS
+    if (trans->first != PROFILE_NO_EVENT)
+        flags |= PKT_FLAG_TRANSITIONS_FIRST | (trans->first << PKT_FLAG_TRANSITIONS_FIRST_SHIFT);
+
+    unsigned len = 0;
+    pkt_tag_union_t tag = { .typed = { .kind = PKT_KIND_TRANSITIONS, .flags = flags } };
+    pkt[len++] = tag.raw;
+    memcpy(pkt + len, trans->counts, sizeof(trans->counts));
+    len += sizeof(trans->counts);
+    return len;
+}
+#endif // CONFIG_PROFILE_TRANSITIONS
+#endif // CONFIG_COLLECT_ENERGY_PROFILE
+
+#ifdef CONFIG_ENERGY_BUDGET
+unsigned budget_to_pkt(uint8_t *pkt, const budget_t *budget, unsigned flags)
+{
+    unsigned len = 0;
+    pkt_tag_union_t tag = { .typed = { .kind = PKT_KIND_ENERGY_BUDGET, .flags = flags } };
+    pkt[len++] = tag.raw;
+    memcpy(pkt + len, budget, sizeof(budget_t));
+    len += sizeof(budget_t);
+    return len;
+}
+#endif // CONFIG_ENERGY_BUDGET
+
+#ifdef CONFIG_BOOT_TIMING
+unsigned boot_timing_to_pkt(uint8_t *pkt, const boot_timing_t *timing, unsigned flags)
+{
+    unsigned len = 0;
+    pkt_tag_union_t tag = { .typed = { .kind = PKT_KIND_BOOT_TIMING, .flags = flags } };
+    pkt[len++] = tag.raw;
+    memcpy(pkt + len, timing, sizeof(boot_timing_t));
+    len += sizeof(boot_timing_t);
+    return len;
+}
+#endif // CONFIG_BOOT_TIMING
+
+#ifdef CONFIG_PKT_QUEUES
+// Indexed by pkt_type_t
+static const uint8_t queue_priority[] = {
+    [PKT_TYPE_ENERGY_PROFILE] = PKT_QUEUE_PRIORITY_ENERGY_PROFILE,
+    [PKT_TYPE_APP_OUTPUT] = PKT_QUEUE_PRIORITY_APP_OUTPUT,
+};
+static const bool queue_newest_first[] = {
+    [PKT_TYPE_ENERGY_PROFILE] = PKT_QUEUE_NEWEST_FIRST_ENERGY_PROFILE,
+    [PKT_TYPE_APP_OUTPUT] = PKT_QUEUE_NEWEST_FIRST_APP_OUTPUT,
+};
+#endif // CONFIG_PKT_QUEUES
+
+// Upper bound on pkts in the store: 1-byte payloads without padding
+#define PKT_STORE_MAX_PKTS (FLASH_STORAGE_SEGMENT_SIZE / (1 + PAYLOAD_DESC_SIZE))
+
+// A pkt in the store in flash
+typedef struct {
+    uint8_t *desc_addr;
+    uint8_t *addr; // payload
+    pkt_desc_t desc;
+} saved_pkt_t;
+
+static uint16_t full_sent_mask(unsigned len)
+{
+    return 0xFFFF >> (16 - (len + 1 /* multibyte pkt header */));
+}
+
 // 'loc' must be the result of a successful call to flash_find_space()
 // Len < 2^4
-flash_status_t save_payload(flash_loc_t *loc, pkt_type_t pkt_type, uint8_t *pkt_data, unsigned len)
+static flash_status_t save_pkt(flash_loc_t *loc, pkt_type_t pkt_type, uint8_t *pkt_data, unsigned len,
+                               uint16_t sent_mask, unsigned stop)
 {
-    pkt_desc_union_t pkt_desc = { .typed = { .sent_mask = 0xFFFF >> (16 - (len + 1 /* multibyte pkt header */)),
+    pkt_desc_union_t pkt_desc = { .typed = { .sent_mask = sent_mask,
                                              .header = { .typed = { .type = pkt_type,
                                                                     .size = len,
                                                                     .padded = (loc->bit_idx & 0x1) ^ (len & 0x1),
+                                                                    .stop = stop,
                                                                     .pay_chksum = 0,
                                                                     .hdr_chksum = 0,
                                                                 } } } };
@@ -104,6 +271,21 @@ flash_status_t save_payload(flash_loc_t *loc, pkt_type_t pkt_type, uint8_t *pkt_
     return FLASH_STATUS_OK;
 }
 
+// 'loc' must be the result of a successful call to flash_find_space()
+// Len < 2^4
+flash_status_t save_payload(flash_loc_t *loc, pkt_type_t pkt_type, uint8_t *pkt_data, unsigned len)
+{
+    return save_pkt(loc, pkt_type, pkt_data, len, full_sent_mask(len), /* stop */ 0);
+}
+
+#ifdef CONFIG_COLLECT_ENERGY_PROFILE
+flash_status_t save_profile_payload(flash_loc_t *loc, uint8_t *pkt_data, unsigned len,
+                                    profile_stop_t stop)
+{
+    return save_pkt(loc, PKT_TYPE_ENERGY_PROFILE, pkt_data, len, full_sent_mask(len), stop);
+}
+#endif // CONFIG_COLLECT_ENERGY_PROFILE
+
 static bool is_pkt_header_valid(pkt_header_union_t *hdr)
 {
     CRCINIRES = 0xFFFF; // init value for checksum
@@ -119,65 +301,285 @@ static bool is_pkt_header_valid(pkt_header_union_t *hdr)
     return true;
 }
 
-bool transmit_saved_payload()
+// Reads the pkt with the descriptor at 'desc_addr', returns false if the pkt header is invalid
+static bool read_saved_pkt(uint8_t *desc_addr, saved_pkt_t *pkt)
+{
+    pkt_desc_union_t desc_union;
+    desc_union.raw = AS_PKT_DESC(desc_addr); // read from flash
+    pkt_desc_t desc = desc_union.typed;
+    pkt_header_t header = desc.header.typed;
+
+    LOG("consider pkt desc: %04x %04x: type %u size %u pad %u | chksum: payload %x hdr %x\r\n",
+        (uint16_t)(desc_union.raw >> 16), (uint16_t)(desc_union.raw & 0xFFFF),
+        header.type, header.size, header.padded, header.pay_chksum, header.hdr_chksum);
+
+    if (!is_pkt_header_valid(&desc.header))
+        return false;
+
+    pkt->desc_addr = desc_addr;
+    pkt->desc = desc;
+    pkt->addr = desc_addr - header.size - header.padded;
+    return true;
+}
+
+// Returns the address of the descriptor of the last pkt written, or NULL if store is empty
+static uint8_t *find_last_pkt_desc()
+{
+    uint8_t *last_byte = flash_find_last_byte();
+    LOG("last byte @0x%04x\r\n", (uint16_t)last_byte);
+    if (!last_byte)
+        return NULL;
+    return last_byte - (PAYLOAD_DESC_SIZE - 1); // move to first byte of the pkt descriptor
+}
+
+#if defined(CONFIG_PKT_QUEUES) || defined(CONFIG_BEACON_STATUS)
+// Lists the pkts in the store, oldest first, back to the first pkt or to a
+// pkt with an invalid header. Returns the number of pkts.
+static unsigned list_saved_pkts(saved_pkt_t *pkts, unsigned max_pkts)
+{
+    unsigned count = 0;
+    uint8_t *desc_addr = find_last_pkt_desc();
+    if (!desc_addr)
+        return 0;
+
+    // Walk backwards (to the left), filling the list from the end
+    while (count < max_pkts && desc_addr >= flash_store_addr()) {
+        saved_pkt_t *pkt = &pkts[max_pkts - 1 - count];
+        if (!read_saved_pkt(desc_addr, pkt)) {
+            LOG("reached invalid pkt header\r\n");
+            break;
+        }
+        ++count;
+        desc_addr = pkt->addr - PAYLOAD_DESC_SIZE;
+    }
+
+    memmove(pkts, pkts + max_pkts - count, count * sizeof(saved_pkt_t));
+    LOG("pkts in store: %u\r\n", count);
+    return count;
+}
+#endif // CONFIG_PKT_QUEUES || CONFIG_BEACON_STATUS
+
+#ifdef CONFIG_BEACON_STATUS
+static void collect_beacon_status(beacon_status_union_t *status)
+{
+    status->raw = 0;
+    status->typed.marker0 = 1;
+    status->typed.marker1 = 3;
+    status->typed.marker2 = 1;
+
+    saved_pkt_t pkts[PKT_STORE_MAX_PKTS];
+    unsigned count = list_saved_pkts(pkts, PKT_STORE_MAX_PKTS);
+
+    unsigned unsent = 0;
+    for (int i = 0; i < count; ++i) {
+        if (pkts[i].desc.sent_mask)
+            ++unsent;
+    }
+    status->typed.unsent = unsent < 0x7 ? unsent : 0x7;
+
+#ifdef CONFIG_COLLECT_ENERGY_PROFILE
+    // Stop reason is in the descriptor of the newest profile pkt (see
+    // save_profile_payload())
+    for (int i = count - 1; i >= 0; --i) {
+        pkt_header_t header = pkts[i].desc.header.typed;
+        if (header.type != PKT_TYPE_ENERGY_PROFILE)
+            continue;
+        pkt_tag_union_t tag = { .raw = *pkts[i].addr };
+        if (header.size == PROFILE_SIZE || // untagged
+            tag.typed.kind == PKT_KIND_PROFILE ||
+            tag.typed.kind == PKT_KIND_PROFILE_PROGRESSIVE ||
+            tag.typed.kind == PKT_KIND_PROFILE_SUM) {
+            status->typed.stop = header.stop;
+            break;
+        }
+    }
+#endif // CONFIG_COLLECT_ENERGY_PROFILE
+
+    flash_loc_t loc;
+    unsigned used = flash_store_size() - flash_find_space(0, &loc);
+    status->typed.flash = used * 4 / flash_store_size() < 3 ? used * 4 / flash_store_size() : 3;
+
+    int vbank = sense_vbank();
+    int level = vbank > BEACON_VBANK_MIN ? (vbank - BEACON_VBANK_MIN) / BEACON_VBANK_STEP : 0;
+    status->typed.vbank = level < 7 ? level : 7;
+
+    CRCINIRES = 0xFFFF; // init value for checksum
+    CRCDI = status->raw;
+    __delay_cycles(2); // word CRC takes 2 cycles, so need to delay by at least 1
+    status->typed.chksum = CRCINIRES & 0x3;
+
+    LOG("beacon status: unsent %u vbank %u flash %u stop %u chksum %u\r\n",
+        status->typed.unsent, status->typed.vbank, status->typed.flash,
+        status->typed.stop, status->typed.chksum);
+}
+#endif // CONFIG_BEACON_STATUS
+
+#ifdef CONFIG_PKT_QUEUES
+// Picks the next pkt from the queue with the highest priority. A pkt with
+// some chunks already sent is finished first, since the ground station
+// reassembles the chunks of one pkt at a time per type.
+static bool find_pkt_to_send(saved_pkt_t *pkt)
+{
+    saved_pkt_t pkts[PKT_STORE_MAX_PKTS];
+    unsigned count = list_saved_pkts(pkts, PKT_STORE_MAX_PKTS);
+
+    int best = -1;
+    for (int i = 0; i < count; ++i) {
+        pkt_header_t header = pkts[i].desc.header.typed;
+        uint16_t sent_mask = pkts[i].desc.sent_mask;
+
+        if (!sent_mask) // sent
+            continue;
+
+        if (sent_mask != full_sent_mask(header.size)) { // partially sent
+            best = i;
+            break;
+        }
+
+        if (best < 0) {
+            best = i;
+            continue;
+        }
+
+        pkt_type_t best_type = pkts[best].desc.header.typed.type;
+        if (queue_priority[header.type] < queue_priority[best_type] ||
+            (header.type == best_type && queue_newest_first[header.type]))
+            best = i;
+    }
+
+    if (best < 0)
+        return false;
+
+    *pkt = pkts[best];
+    return true;
+}
+
+// Bytes taken by a pkt in the store, if it were written at the worst-case location
+static unsigned pkt_footprint(unsigned len)
+{
+    return len + 1 /* padding */ + PAYLOAD_DESC_SIZE;
+}
+
+flash_status_t pkt_store_evict(unsigned len, unsigned *evicted)
+{
+    saved_pkt_t pkts[PKT_STORE_MAX_PKTS];
+    bool keep[PKT_STORE_MAX_PKTS];
+    unsigned count = list_saved_pkts(pkts, PKT_STORE_MAX_PKTS);
+
+    unsigned used = 0;
+    for (int i = 0; i < count; ++i) {
+        keep[i] = pkts[i].desc.sent_mask != 0; // drop sent pkts
+        if (keep[i])
+            used += pkt_footprint(pkts[i].desc.header.typed.size);
+    }
+
+    *evicted = 0;
+    while (used + len > flash_store_size()) {
+        // Oldest pkt from the queue with the lowest priority
+        int victim = -1;
+        for (int i = 0; i < count; ++i) {
+            if (keep[i] && (victim < 0 || queue_priority[pkts[i].desc.header.typed.type] >
+                                          queue_priority[pkts[victim].desc.header.typed.type]))
+                victim = i;
+        }
+        if (victim < 0) // store will be empty
+            break;
+
+        LOG("evict pkt: addr 0x%04x type %u\r\n",
+            (uint16_t)pkts[victim].addr, pkts[victim].desc.header.typed.type);
+        keep[victim] = false;
+        used -= pkt_footprint(pkts[victim].desc.header.typed.size);
+        ++*evicted;
+    }
+
+    // Rewrite the kept pkts in their original order, with their sent masks.
+    // Flash can't be freed in parts, so the kept pkts go through RAM, and
+    // are lost if power fails before they are written back: leave them in
+    // flash until there is the energy for the erase and the rewrite.
+    if (used > 0 && sense_vbank() < PKT_QUEUE_EVICT_VBANK_MIN) {
+        LOG("evict: Vbank low: not erasing %u bytes of pkts\r\n", used);
+        *evicted = 0;
+        return FLASH_STATUS_LOW_ENERGY;
+    }
+
+    uint8_t store[FLASH_STORAGE_SEGMENT_SIZE] __attribute__((aligned(2)));
+    memcpy(store, flash_store_addr(), flash_store_size());
+
+    if (!flash_erase())
+        return FLASH_STATUS_WRITE_FAILED;
+
+    for (int i = 0; i < count; ++i) {
+        if (!keep[i])
+            continue;
+
+        pkt_header_t header = pkts[i].desc.header.typed;
+        flash_loc_t loc;
+        flash_find_space(pkt_footprint(header.size), &loc);
+        flash_status_t rc = save_pkt(&loc, header.type, store + (pkts[i].addr - flash_store_addr()),
+                                     header.size, pkts[i].desc.sent_mask, header.stop);
+        if (rc != FLASH_STATUS_OK)
+            return rc;
+    }
+
+    return FLASH_STATUS_OK;
+}
+#else // !CONFIG_PKT_QUEUES
+// Finds the oldest unsent pkt after the last sent pkt
+static bool find_pkt_to_send(saved_pkt_t *pkt)
 {
     // Start at last pkt written, and walk backwards (to the left)
-    LOG("look for unsent pkt in flash\r\n");
-    uint8_t *prev_saved_pkt_desc_addr = flash_find_last_byte();
-    LOG("last byte @0x%04x\r\n", (uint16_t)prev_saved_pkt_desc_addr);
+    uint8_t *prev_saved_pkt_desc_addr = find_last_pkt_desc();
     if (!prev_saved_pkt_desc_addr) {
         LOG("no saved pkt found in flash\r\n");
         return false;
     }
-    prev_saved_pkt_desc_addr -= PAYLOAD_DESC_SIZE - 1; // move to first byte of the pkt descriptor
     LOG("pkt desc @0x%04x\r\n", (uint16_t)prev_saved_pkt_desc_addr);
 
-    uint8_t *saved_pkt_desc_addr = NULL;
-    uint8_t *saved_pkt_addr = NULL;
-    pkt_desc_t saved_pkt_desc;
-    pkt_header_t saved_pkt_header;
-
+    bool found = false;
     do {
 
         // consider the prev pkt
 
-        pkt_desc_union_t prev_saved_pkt_desc_union;
-        prev_saved_pkt_desc_union.raw = AS_PKT_DESC(prev_saved_pkt_desc_addr); // read from flash
-        pkt_desc_t prev_saved_pkt_desc = prev_saved_pkt_desc_union.typed;
-        pkt_header_t prev_saved_pkt_header = prev_saved_pkt_desc.header.typed;
-
-        LOG("consider pkt desc: %04x %04x: type %u size %u pad %u | chksum: payload %x hdr %x\r\n",
-            (uint16_t)(prev_saved_pkt_desc_union.raw >> 16), (uint16_t)(prev_saved_pkt_desc_union.raw & 0xFFFF),
-            prev_saved_pkt_header.type, prev_saved_pkt_header.size, prev_saved_pkt_header.padded,
-            prev_saved_pkt_header.pay_chksum, prev_saved_pkt_header.hdr_chksum);
-
-        if (!is_pkt_header_valid(&prev_saved_pkt_desc.header)) {
+        saved_pkt_t prev_saved_pkt;
+        if (!read_saved_pkt(prev_saved_pkt_desc_addr, &prev_saved_pkt)) {
             LOG("reached invalid pkt header\r\n");
             break;
         }
 
-        if (!prev_saved_pkt_desc.sent_mask) {
+        if (!prev_saved_pkt.desc.sent_mask) {
             LOG("reached sent pkt\r\n");
             break;
         }
 
         // pkt header is valid and pkt is not sent, set curser on it and keep walking
         LOG("pkt descriptor valid: addr 0x%04x desc\r\n", (uint16_t)prev_saved_pkt_desc_addr);
-        saved_pkt_desc_addr = prev_saved_pkt_desc_addr;
-        saved_pkt_desc = prev_saved_pkt_desc;
-        saved_pkt_header = prev_saved_pkt_header;
-        saved_pkt_addr = ((uint8_t*)saved_pkt_desc_addr) - saved_pkt_header.size - saved_pkt_header.padded;
+        *pkt = prev_saved_pkt;
+        found = true;
 
-        prev_saved_pkt_desc_addr = saved_pkt_addr - PAYLOAD_DESC_SIZE;
+        prev_saved_pkt_desc_addr = pkt->addr - PAYLOAD_DESC_SIZE;
         LOG("prev pkt desc addr: 0x%04x\r\n", (uint16_t)prev_saved_pkt_desc_addr);
 
     } while (flash_addr_in_range(prev_saved_pkt_desc_addr));
 
-    if (saved_pkt_desc_addr == NULL) {
+    return found;
+}
+#endif // !CONFIG_PKT_QUEUES
+
+bool transmit_saved_payload()
+{
+    LOG("look for unsent pkt in flash\r\n");
+
+    saved_pkt_t saved_pkt;
+    if (!find_pkt_to_send(&saved_pkt)) {
         LOG("no valid unsent pkt found in flash\r\n");
         return false;
     }
 
+    uint8_t *saved_pkt_desc_addr = saved_pkt.desc_addr;
+    uint8_t *saved_pkt_addr = saved_pkt.addr;
+    pkt_desc_t saved_pkt_desc = saved_pkt.desc;
+    pkt_header_t saved_pkt_header = saved_pkt_desc.header.typed;
+
     LOG("pkt payload (addr 0x%04x len %u): ", (uint16_t)saved_pkt_addr, saved_pkt_header.size);
     for(int i = 0; i < saved_pkt_header.size; ++i) {
         LOG("%02x ", *(saved_pkt_addr + i));
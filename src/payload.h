@@ -7,6 +7,18 @@
 #include "profile.h"
 #endif
 
+#ifdef CONFIG_PROFILE_ACCUMULATE
+#include "accum.h"
+#endif
+
+#ifdef CONFIG_ENERGY_BUDGET
+#include "budget.h"
+#endif
+
+#ifdef CONFIG_BOOT_TIMING
+#include "boottime.h"
+#endif
+
 #include "flash.h"
 
 typedef enum {
@@ -19,6 +31,82 @@ typedef enum {
 
 #define BEACON 0xED
 
+// Payloads of type PKT_TYPE_ENERGY_PROFILE other than a plain profile_t start
+// with a tag byte. The ground station tells them apart by size: a payload
+// of exactly PROFILE_SIZE bytes is an untagged profile.
+typedef enum {
+    PKT_KIND_PROFILE            = 0,
+    PKT_KIND_ENERGY_BUDGET      = 1,
+    PKT_KIND_TRANSITIONS        = 2,
+    PKT_KIND_BOOT_TIMING        = 3,
+    PKT_KIND_PROFILE_PROGRESSIVE = 4, // flags as for PKT_KIND_PROFILE
+    PKT_KIND_PROFILE_SUM        = 5,
+    // NOTE: field size is 3 bits
+} pkt_kind_t;
+
+// Flags for PKT_KIND_PROFILE
+#define PKT_FLAG_PROFILE_PARTIAL 0x01 // run was cut short, recovered from a checkpoint
+#define PKT_FLAG_PROFILE_EDGES   0x02 // profile followed by the bin edge byte
+#define PKT_FLAG_PROFILE_APPROX  0x04 // counters are logarithmic (Morris) counters
+#define PKT_FLAG_PROFILE_STOP_SHIFT 3 // 2 bits: why the run stopped (profile_stop_t), only in sums
+
+// Flags for PKT_KIND_PROFILE_SUM: PARTIAL if any run in the sum was recovered
+// from a checkpoint, and STOP of the last run, as for PKT_KIND_PROFILE
+#define PKT_FLAG_PROFILE_SUM_OVERFLOW 0x02 // a run stopped on counter overflow
+
+// Flags for PKT_KIND_ENERGY_BUDGET
+#define PKT_FLAG_BUDGET_SENT     0x01 // transmit phase sent a chunk or beacon (vs. lookup only)
+
+// Flags for PKT_KIND_TRANSITIONS
+#define PKT_FLAG_TRANSITIONS_APPROX 0x01 // counters are logarithmic (Morris) counters
+#define PKT_FLAG_TRANSITIONS_FIRST  0x02 // a watchpoint was hit: its index is in the next bits
+#define PKT_FLAG_TRANSITIONS_FIRST_SHIFT 2 // 2 bits: watchpoint hit first in the run
+
+// Flags for PKT_KIND_BOOT_TIMING
+#define PKT_FLAG_BOOT_TIMING_FAST   0x01 // fast boot: console phase skipped, init deferred
+
+typedef struct __attribute__((packed)) {
+    // little-endian means these bits in mem are in opposite order
+    unsigned kind:3;
+    unsigned flags:5;
+} pkt_tag_t;
+
+typedef union __attribute__((packed)) {
+    pkt_tag_t typed;
+    uint8_t raw;
+} pkt_tag_union_t;
+
+#ifdef CONFIG_BEACON_STATUS
+// Status sent after the BEACON byte. Bit 4 of each byte is set, so that a
+// status byte is never BEACON. The markers in the first byte make it read as
+// a chunk of type PKT_TYPE_APP_OUTPUT with idx >= 9, which no pkt has, so
+// that the ground station can tell status from a chunk sent after a beacon.
+typedef struct __attribute__((packed)) {
+    // little-endian means these bits in mem are in opposite order
+    unsigned marker0:1; // 1
+    unsigned stop:2;    // why the last profiling run in flash stopped (profile_stop_t)
+    unsigned marker1:2; // 3
+    unsigned unsent:3;  // count of unsent pkts in flash (saturates)
+    unsigned flash:2;   // used fraction of the pkt store, in quarters (rounded down)
+    unsigned chksum:2;
+    unsigned marker2:1; // 1
+    unsigned vbank:3;   // Vbank level: BEACON_VBANK_MIN + vbank * BEACON_VBANK_STEP or above
+} beacon_status_t;
+
+typedef union __attribute__((packed)) {
+    beacon_status_t typed;
+    uint16_t raw;
+} beacon_status_union_t;
+#endif // CONFIG_BEACON_STATUS
+
+// Beacon as transmitted: the BEACON byte alone, or followed by the status
+typedef struct __attribute__((packed)) {
+    uint8_t beacon; // BEACON
+#ifdef CONFIG_BEACON_STATUS
+    beacon_status_union_t status; // low byte first
+#endif // CONFIG_BEACON_STATUS
+} beacon_pkt_t;
+
 // Header of packet saved in flash
 // NOTE: could shrink to 1 byte by having fixed size and a 3-bit header CRC
 typedef struct __attribute__((packed)) {
@@ -28,6 +116,7 @@ typedef struct __attribute__((packed)) {
         unsigned size:4; // bytes (15 bytes max)
         unsigned padded:1; // whether the pkt payload size is odd
         pkt_type_t type:1;
+        unsigned stop:2; // profiles: why the run stopped (profile_stop_t), for beacons
 } pkt_header_t;
 
 #define PKT_HDR_DATA(h) (h & 0xfff0) // mask hdr_checksum
@@ -81,7 +170,71 @@ void payload_init();
 void payload_send_beacon();
 bool payload_send_pkt(rad_pkt_union_t *pkt);
 
+#ifdef CONFIG_COLLECT_ENERGY_PROFILE
+// With CONFIG_PROFILE_PROGRESSIVE, the profile in the pkt is reordered by
+// significance: for each bit position from the top, that bit of each
+// counter of each event (count, then bins), packed from the LSB of each
+// byte. Each received chunk narrows the range of every counter.
+//
+// With CONFIG_PROFILE_DUTY_CYCLE, the profile is followed by the duty cycle
+// byte (profile_duty_cycle). The ground station tells it from the bin edge
+// byte by the EDGES flag: the two are never in the same pkt.
+#if defined(CONFIG_PROFILE_ADAPTIVE_BINS)
+#define PROFILE_PKT_MAX_SIZE (1 + PROFILE_SIZE + 1) // tag, profile, bin edge
+#elif defined(CONFIG_PROFILE_DUTY_CYCLE)
+#define PROFILE_PKT_MAX_SIZE (1 + PROFILE_SIZE + 1) // tag, profile, duty cycle
+#else // !CONFIG_PROFILE_ADAPTIVE_BINS && !CONFIG_PROFILE_DUTY_CYCLE
+#define PROFILE_PKT_MAX_SIZE (1 + PROFILE_SIZE) // tag, profile
+#endif // !CONFIG_PROFILE_ADAPTIVE_BINS && !CONFIG_PROFILE_DUTY_CYCLE
+
+// Serialize the profile into pkt (of PROFILE_PKT_MAX_SIZE), returns the length
+unsigned profile_to_pkt(uint8_t *pkt, const profile_t *prof, unsigned flags);
+
+#ifdef CONFIG_PROFILE_ACCUMULATE
+#define PROFILE_SUM_PKT_SIZE (1 + sizeof(profile_sum_t)) // tag, sum
+
+// Serialize the sum of profiles into pkt (of PROFILE_SUM_PKT_SIZE), returns the length
+unsigned profile_sum_to_pkt(uint8_t *pkt, const profile_sum_t *sum, unsigned flags);
+#endif // CONFIG_PROFILE_ACCUMULATE
+
+#ifdef CONFIG_PROFILE_TRANSITIONS
+#define TRANSITIONS_PKT_SIZE (1 + sizeof(profile_transitions.counts)) // tag, counters
+
+// Serialize the transition counts into pkt (of TRANSITIONS_PKT_SIZE), returns the length
+unsigned transitions_to_pkt(uint8_t *pkt, const profile_transitions_t *trans);
+#endif // CONFIG_PROFILE_TRANSITIONS
+#endif // CONFIG_COLLECT_ENERGY_PROFILE
+
+#ifdef CONFIG_ENERGY_BUDGET
+#define BUDGET_PKT_SIZE (1 + sizeof(budget_t)) // tag, budget
+
+// Serialize the energy budget into pkt (of BUDGET_PKT_SIZE), returns the length
+unsigned budget_to_pkt(uint8_t *pkt, const budget_t *budget, unsigned flags);
+#endif // CONFIG_ENERGY_BUDGET
+
+#ifdef CONFIG_BOOT_TIMING
+#define BOOT_TIMING_PKT_SIZE (1 + sizeof(boot_timing_t)) // tag, durations
+
+// Serialize the boot phase durations into pkt (of BOOT_TIMING_PKT_SIZE), returns the length
+unsigned boot_timing_to_pkt(uint8_t *pkt, const boot_timing_t *timing, unsigned flags);
+#endif // CONFIG_BOOT_TIMING
+
 flash_status_t save_payload(flash_loc_t *loc, pkt_type_t pkt_type, uint8_t *pkt_data, unsigned len);
+#ifdef CONFIG_COLLECT_ENERGY_PROFILE
+// As save_payload() for a profile pkt, with why the run stopped in its
+// descriptor, where beacons find it without it taking space in the pkt
+flash_status_t save_profile_payload(flash_loc_t *loc, uint8_t *pkt_data, unsigned len,
+                                    profile_stop_t stop);
+#endif // CONFIG_COLLECT_ENERGY_PROFILE
 bool transmit_saved_payload();
 
+#ifdef CONFIG_PKT_QUEUES
+// Make room for 'len' bytes in the store by dropping sent pkts and evicting
+// unsent pkts from the lowest-priority queue, oldest first, only as many as
+// needed. The store is erased, so call only when it is full; if it holds pkts
+// to keep and Vbank is below PKT_QUEUE_EVICT_VBANK_MIN, nothing is erased
+// (FLASH_STATUS_LOW_ENERGY).
+flash_status_t pkt_store_evict(unsigned len, unsigned *evicted);
+#endif // CONFIG_PKT_QUEUES
+
 #endif // PAYLOAD_H
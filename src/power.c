@@ -14,12 +14,10 @@ uint16_t sense_vbank()
     //Reset the ENC bit to set the starting memory address and conversion mode sequence
     ADC12CTL0 &= ~(ADC12ENC);
 
-    REFCTL0 |= REFMSTR | REFTCOFF; // use reference control bits in REF, disable temp sensor
-    REFCTL0 |= REFON; // turn on reference (TODO: is this needed? or will ADC turn it on on demand?)
-
     ADC12CTL1 |= ADC12SHP;
     ADC12CTL0 |= ADC12SHT0_15 | ADC12SHT1_15;
-    ADC12MCTL0 |= 0x4 | ADC12SREF_1 | ADC12EOS; // channel A4
+    // Channel A4, referenced to AVCC (VDD_EDB): divided Vbank is above the 1.5V reference
+    ADC12MCTL0 = 0x4 | ADC12SREF_0 | ADC12EOS;
 
     //Reset the bits about to be set
     ADC12CTL1 &= ~(ADC12CONSEQ_3);
@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stddef.h>
 
 #include <libio/console.h>
 #include <libmsp/periph.h>
@@ -11,6 +12,24 @@
 
 #include "profile.h"
 
+#ifdef CONFIG_PROFILE_CHECKPOINT
+#include "checkpoint.h"
+#endif // CONFIG_PROFILE_CHECKPOINT
+
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+#include "ehist.h"
+#endif // CONFIG_PROFILE_ADAPTIVE_BINS
+
+#if defined(CONFIG_PROFILE_APPROX_COUNTS) || defined(CONFIG_PROFILE_DUTY_CYCLE)
+#include "random.h"
+#endif // CONFIG_PROFILE_APPROX_COUNTS || CONFIG_PROFILE_DUTY_CYCLE
+
+// Follow Vbank down the comparator ladder during profiling
+#if defined(CONFIG_PROFILE_PREDICTIVE_STOP) || defined(CONFIG_PROFILE_COMP_BINS)
+#define VBANK_TAP_TRACKING
+#include "power.h"
+#endif // CONFIG_PROFILE_PREDICTIVE_STOP || CONFIG_PROFILE_COMP_BINS
+
 // Shorthand
 #define COMP_VBANK(...)  COMP(COMP_TYPE_VBANK, __VA_ARGS__)
 #define COMP2_VBANK(...) COMP2(COMP_TYPE_VBANK, __VA_ARGS__)
@@ -20,6 +39,23 @@
 __attribute__((aligned(2)))
 profile_t profile;
 
+// Counters during the run, a word per field of event_t, so that the callback
+// increments them in place instead of through bitfield code. A counter goes
+// past the max of its field when it overflows, which sets the bit above the
+// field: the callback tests that bit, and profile_pack() saturates.
+#define PROFILE_FIELD_COUNTER(name, bits) uint16_t name;
+typedef struct {
+    PROFILE_EVENT_FIELDS(PROFILE_FIELD_COUNTER)
+} event_counters_t;
+
+#define PROFILE_FIELD_OVERFLOW(bits) (1 << (bits))
+
+_Static_assert(offsetof(event_counters_t, ehist_bin1) ==
+               offsetof(event_counters_t, ehist_bin0) + sizeof(uint16_t),
+               "bin counters must be adjacent");
+
+static event_counters_t profile_counters[NUM_EVENTS];
+
 // Flag indicating when Vcap drops below threshold to end profiling
 static volatile bool profiling_vcap_ok = false;
 
@@ -28,20 +64,155 @@ static volatile bool profiling_overflow = false;
 
 static volatile bool profiling_timeout = false;
 
+#ifdef CONFIG_PROFILE_TRANSITIONS
+profile_transitions_t profile_transitions;
+static unsigned last_event; // index of the previous watchpoint in the run
+#endif // CONFIG_PROFILE_TRANSITIONS
+
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+uint8_t profile_ehist_edge;
+static uint16_t ehist_bin_edge; // ADC code
+// Streaming estimate of the median of vcap (fixed point, see ehist.h): moves
+// by a fixed step towards each sample, so settles where half are above.
+static uint16_t ehist_edge_est;
+#define EHIST_BIN_EDGE ehist_bin_edge
+#else // !CONFIG_PROFILE_ADAPTIVE_BINS
+#define EHIST_BIN_EDGE PROFILING_EHIST_BIN_EDGE_0
+#endif // !CONFIG_PROFILE_ADAPTIVE_BINS
+
+#ifdef CONFIG_PROFILE_COMP_BINS
+// Bin is from the comparator ladder tap that Vbank is above, not from an
+// ADC conversion of Vcap on every watchpoint (Vcap is Vbank while isolated)
+#define VCAP_SNAPSHOT false
+#else // !CONFIG_PROFILE_COMP_BINS
+#define VCAP_SNAPSHOT true
+#endif // !CONFIG_PROFILE_COMP_BINS
+
+#ifdef VBANK_TAP_TRACKING
+// Vbank is followed down the comparator ladder one tap at a time: the
+// harvester is disconnected during profiling, so Vbank only falls, and is
+// always above the tap for the next crossing. With the predictive stop, the
+// time between crossings gives the discharge rate, from which the ISR
+// predicts whether the run can go on to the next tap and still have the
+// energy to save the pkts once it stops there.
+static volatile unsigned vbank_tap; // tap for the next crossing
+#endif // VBANK_TAP_TRACKING
+
+#ifdef CONFIG_PROFILE_PREDICTIVE_STOP
+static uint16_t vbank_tap_time; // timer count at the last crossing
+static bool vbank_tap_crossed;  // a crossing happened: interval to the next is a full tap
+#endif // CONFIG_PROFILE_PREDICTIVE_STOP
+
+#ifdef CONFIG_PROFILE_CHECKPOINT
+// The timeout interval is split into checkpoint intervals
+static unsigned profiling_ticks_left;
+static volatile bool profiling_checkpoint_due = false;
+#endif // CONFIG_PROFILE_CHECKPOINT
+
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+// Watchpoints are enabled in one window of PROFILING_DUTY_WINDOW ticks of
+// Timer_B0 per period of PROFILING_DUTY_PERIOD ticks. The window starts at a
+// random offset within each period, so that the sampling does not alias with
+// periodic behavior of the app. The offset leaves at least one tick between
+// the end of a window and the start of the next one. Intervals are correct
+// across timer wrap around, since runs are shorter than that (128 s).
+uint8_t profile_duty_cycle = PROFILE_DUTY_CYCLE_NOMINAL;
+static uint16_t duty_run_start;     // timer count at the start of the run
+static uint16_t duty_period_start;  // timer count at the start of the current period
+static uint16_t duty_enabled_ticks; // total length of the windows closed so far
+static volatile bool duty_window_open;
+#endif // CONFIG_PROFILE_DUTY_CYCLE
+
+#ifdef VBANK_TAP_TRACKING
+static void set_vbank_tap(unsigned tap)
+{
+    vbank_tap = tap;
+    // Same tap on both sides of the hysteresis, so that after a crossing the
+    // output goes low again, and the next crossing raises the flag. The tap
+    // is not a constant, so no REFx_n macros.
+    COMP_VBANK(CTL2) = COMP_VBANK(RS_1) | tap * COMP2_VBANK(REF0_, 1) |
+                                          tap * COMP2_VBANK(REF1_, 1);
+}
+
+// Called on a crossing of vbank_tap: returns whether to keep profiling
+static bool track_vbank_tap()
+{
+    unsigned next = vbank_tap - 1;
+#ifdef CONFIG_PROFILE_PREDICTIVE_STOP
+    uint16_t now = TB0R;
+    uint16_t interval = now - vbank_tap_time; // ticks per tap, correct across wrap around
+    vbank_tap_time = now;
+
+    if (!vbank_tap_crossed) {
+        // Vbank started somewhere within the tap: no rate yet, so keep to the fixed threshold
+        vbank_tap_crossed = true;
+        if (next < PROFILING_VBANK_MIN_DOWN)
+            return false;
+    } else {
+        // After the crossing of the next tap, the load keeps discharging the bank
+        // at the current rate for up to PROFILING_STOP_MARGIN, which must leave
+        // Vbank above the level needed for the save.
+        if (next <= PROFILING_VBANK_SAVE_TAP ||
+            (uint32_t)(next - PROFILING_VBANK_SAVE_TAP) * interval < PROFILING_STOP_MARGIN)
+            return false;
+    }
+#else // !CONFIG_PROFILE_PREDICTIVE_STOP
+    if (next < PROFILING_VBANK_MIN_DOWN)
+        return false;
+#endif // !CONFIG_PROFILE_PREDICTIVE_STOP
+
+    set_vbank_tap(next);
+    return true;
+}
+#endif // VBANK_TAP_TRACKING
+
+#if defined(CONFIG_PROFILE_PREDICTIVE_STOP) || defined(CONFIG_PROFILE_DUTY_CYCLE)
+static void start_profiling_timer()
+{
+    if (!(TB0CTL & MC_3)) { // unless already started for the energy budget
+        TB0CTL = TBSSEL_1 | ID_3 | TBCLR; // ACLK / 8
+        TB0EX0 = TBIDEX_7; // further / 8
+        TB0CTL |= MC_2; // continuous
+    }
+}
+#endif // CONFIG_PROFILE_PREDICTIVE_STOP || CONFIG_PROFILE_DUTY_CYCLE
+
 static bool arm_vcap_comparator()
 {
     // Configure comparator to interrupt when Vcap drops below a threshold
     COMP_VBANK(CTL3) |= COMP2_VBANK(PD, COMP_CHAN_VBANK);
     COMP_VBANK(CTL0) = COMP_VBANK(IMEN) | COMP2_VBANK(IMSEL_, COMP_CHAN_VBANK);
     // VDD applied to resistor ladder, ladder tap applied to V+ terminal
+#ifdef VBANK_TAP_TRACKING
+    // Start at the tap below Vbank, but not below the fixed threshold. ADC
+    // reference and ladder are both VDD, so the tap is the top bits of the
+    // ADC code.
+    unsigned tap = sense_vbank() / (4096 / COMP_TAPS);
+    tap = tap > PROFILING_VBANK_MIN_DOWN + 1 ? tap - 1 : PROFILING_VBANK_MIN_DOWN;
+    set_vbank_tap(tap);
+#ifdef CONFIG_PROFILE_PREDICTIVE_STOP
+    vbank_tap_crossed = false;
+    start_profiling_timer();
+    vbank_tap_time = TB0R;
+#endif // CONFIG_PROFILE_PREDICTIVE_STOP
+#else // !VBANK_TAP_TRACKING
     COMP_VBANK(CTL2) = COMP_VBANK(RS_1) | COMP2_VBANK(REF0_, PROFILING_VBANK_MIN_DOWN) |
                                           COMP2_VBANK(REF1_, PROFILING_VBANK_MIN_UP);
+#endif // !VBANK_TAP_TRACKING
     // Turn comparator on in ultra-low power mode
     COMP_VBANK(CTL1) |= COMP_VBANK(PWRMD_2) | COMP_VBANK(ON);
 
     // Let the comparator output settle before checking or setting up interrupt
     msp_sleep(PERIOD_VBANK_COMP_SETTLE);
 
+#ifdef VBANK_TAP_TRACKING
+    // ADC noise may have put the starting tap above Vbank
+    while ((COMP_VBANK(CTL1) & COMP_VBANK(OUT)) && vbank_tap > PROFILING_VBANK_MIN_DOWN) {
+        set_vbank_tap(vbank_tap - 1);
+        msp_sleep(PERIOD_VBANK_COMP_SETTLE);
+    }
+#endif // VBANK_TAP_TRACKING
+
     if (COMP_VBANK(CTL1) & COMP_VBANK(OUT)) {
         // Vcap already below threshold
         return false;
@@ -57,7 +228,7 @@ static bool arm_vcap_comparator()
 static void toggle_watchpoints(bool enable)
 {
     for (unsigned i = 0; i < NUM_EVENTS; ++i)
-        toggle_watchpoint(i, /* enable */ enable, /* vcap snapshot */ true);
+        toggle_watchpoint(i, /* enable */ enable, /* vcap snapshot */ VCAP_SNAPSHOT);
 
     // actually configure the pins
     if (enable)
@@ -66,42 +237,177 @@ static void toggle_watchpoints(bool enable)
         disable_watchpoints();
 }
 
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+static void schedule_duty_window()
+{
+    TB0CCR1 = duty_period_start +
+              random_fast() % (PROFILING_DUTY_PERIOD - PROFILING_DUTY_WINDOW);
+}
+
+static void start_duty_cycle()
+{
+    start_profiling_timer();
+    // First period from the next tick, so that the window is never at the
+    // current count, which the timer would match only after wrapping around
+    duty_run_start = TB0R;
+    duty_period_start = duty_run_start + 1;
+    duty_enabled_ticks = 0;
+    duty_window_open = false;
+    schedule_duty_window();
+    TB0CCTL1 = CCIE;
+}
+
+// Called from the timer ISR at the start and at the end of each window
+static void on_duty_window_edge()
+{
+    if (!duty_window_open) {
+        toggle_watchpoints(true);
+        duty_window_open = true;
+        TB0CCR1 += PROFILING_DUTY_WINDOW;
+    } else {
+        toggle_watchpoints(false);
+        duty_window_open = false;
+        duty_enabled_ticks += PROFILING_DUTY_WINDOW;
+        duty_period_start += PROFILING_DUTY_PERIOD;
+        schedule_duty_window();
+    }
+}
+
+// Stop the windows, and compute the duty cycle of the run for the pkt: at the
+// end of the run, or on overflow, since counting stops there
+static void stop_duty_cycle()
+{
+    if (!(TB0CCTL1 & CCIE))
+        return; // already stopped on overflow
+    TB0CCTL1 = 0;
+    uint16_t now = TB0R;
+    if (duty_window_open) { // cut short by the end of the run
+        duty_enabled_ticks += now - (TB0CCR1 - PROFILING_DUTY_WINDOW);
+        duty_window_open = false;
+    }
+
+    uint16_t run_ticks = now - duty_run_start;
+    uint32_t duty = run_ticks ? ((uint32_t)duty_enabled_ticks << 8) / run_ticks : 0;
+    profile_duty_cycle = duty > 0xFF ? 0xFF : duty;
+}
+#endif // CONFIG_PROFILE_DUTY_CYCLE
+
 static msp_alarm_action_t on_profiling_timeout()
 {
     profiling_timeout = true;
     return MSP_ALARM_ACTION_WAKEUP;
 }
 
+#ifdef CONFIG_PROFILE_CHECKPOINT
+static msp_alarm_action_t on_profiling_checkpoint()
+{
+    profiling_checkpoint_due = true;
+    return MSP_ALARM_ACTION_WAKEUP;
+}
+
+// Set alarm for the next checkpoint, or for the timeout if it comes first
+static void arm_profiling_alarm()
+{
+    if (profiling_ticks_left > PERIOD_PROFILING_CHECKPOINT) {
+        profiling_ticks_left -= PERIOD_PROFILING_CHECKPOINT;
+        msp_alarm(PERIOD_PROFILING_CHECKPOINT, on_profiling_checkpoint);
+    } else {
+        msp_alarm(profiling_ticks_left, on_profiling_timeout);
+        profiling_ticks_left = 0;
+    }
+}
+#endif // CONFIG_PROFILE_CHECKPOINT
+
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+void restore_ehist_edge()
+{
+    ehist_edge_est = ehist_edge_load();
+    // Binning uses the edge as sent in the pkt, so that ground knows it exactly
+    profile_ehist_edge = EHIST_EDGE_TO_BYTE(ehist_edge_est);
+    ehist_bin_edge = EHIST_EDGE_FROM_BYTE(profile_ehist_edge) >> EHIST_EDGE_FRAC_BITS;
+}
+
+void save_ehist_edge()
+{
+    ehist_edge_save(ehist_edge_est);
+}
+#endif // CONFIG_PROFILE_ADAPTIVE_BINS
+
 void start_profiling()
 {
     LOG("start profiling\r\n");
 
     memset(&profile, 0, sizeof(profile_t));
+    profile_unpack();
+
+#ifdef CONFIG_PROFILE_TRANSITIONS
+    memset(&profile_transitions, 0, sizeof(profile_transitions_t));
+    profile_transitions.first = PROFILE_NO_EVENT;
+    last_event = PROFILE_NO_EVENT;
+#endif // CONFIG_PROFILE_TRANSITIONS
+
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+    restore_ehist_edge();
+    LOG("bin edge: %u (est 0x%04x)\r\n", ehist_bin_edge, ehist_edge_est);
+#endif // CONFIG_PROFILE_ADAPTIVE_BINS
+
+#ifdef CONFIG_PROFILE_CHECKPOINT
+    checkpoint_open(); // before profiling, since it may erase
+#endif // CONFIG_PROFILE_CHECKPOINT
 
     profiling_vcap_ok = arm_vcap_comparator();
     profiling_timeout = false;
+#ifdef CONFIG_PROFILE_CHECKPOINT
+    profiling_checkpoint_due = false;
+    profiling_ticks_left = PERIOD_PROFILING_TIMEOUT;
+    arm_profiling_alarm();
+#else // !CONFIG_PROFILE_CHECKPOINT
     msp_alarm(PERIOD_PROFILING_TIMEOUT, on_profiling_timeout);
+#endif // !CONFIG_PROFILE_CHECKPOINT
 
     LOG("EDB server init\r\n");
     edb_server_init();
     LOG("EDB server done\r\n");
 
     edb_set_watchpoint_callback(profile_event);
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+    start_duty_cycle(); // watchpoints enabled from the first window
+#else // !CONFIG_PROFILE_DUTY_CYCLE
     toggle_watchpoints(true);
+#endif // !CONFIG_PROFILE_DUTY_CYCLE
 
 }
 
 bool continue_profiling()
 {
+#ifdef CONFIG_PROFILE_CHECKPOINT
+    if (profiling_checkpoint_due) {
+        profiling_checkpoint_due = false;
+        profile_pack();
+        checkpoint_save(&profile);
+        arm_profiling_alarm();
+    }
+#endif // CONFIG_PROFILE_CHECKPOINT
+
     return profiling_vcap_ok && !profiling_timeout;
 }
 
 void stop_profiling() {
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+    stop_duty_cycle(); // before disabling, so that no window opens after
+#endif // CONFIG_PROFILE_DUTY_CYCLE
     toggle_watchpoints(false);
+    profile_pack();
 
     __delay_cycles(256); // avoid corruption in softuart output on wakeup
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+    LOG("duty cycle: %u/256\r\n", profile_duty_cycle);
+#endif // CONFIG_PROFILE_DUTY_CYCLE
     LOG("profiling stopped: vcap %u ovrflw %u timeout %u\r\n",
         profiling_vcap_ok, profiling_overflow, profiling_timeout);
+#ifdef VBANK_TAP_TRACKING
+    LOG("vbank tap: %u\r\n", vbank_tap);
+#endif // VBANK_TAP_TRACKING
 
     LOG("profile: %u %u:%u | %u %u:%u | %u %u:%u | %u %u:%u\r\n",
         profile.events[0].count,
@@ -116,43 +422,125 @@ void stop_profiling() {
         profile.events[3].count,
         profile.events[3].ehist_bin0,
         profile.events[3].ehist_bin1);
+
+#ifdef CONFIG_PROFILE_TRANSITIONS
+    LOG("transitions: first %u: %02x %02x %02x %02x %02x %02x %02x %02x\r\n",
+        profile_transitions.first,
+        profile_transitions.counts[0], profile_transitions.counts[1],
+        profile_transitions.counts[2], profile_transitions.counts[3],
+        profile_transitions.counts[4], profile_transitions.counts[5],
+        profile_transitions.counts[6], profile_transitions.counts[7]);
+#endif // CONFIG_PROFILE_TRANSITIONS
+}
+
+profile_stop_t profile_stop_reason()
+{
+    if (profiling_overflow)
+        return PROFILE_STOP_OVERFLOW;
+    if (!profiling_vcap_ok)
+        return PROFILE_STOP_VCAP;
+    if (profiling_timeout)
+        return PROFILE_STOP_TIMEOUT;
+    return PROFILE_STOP_UNKNOWN;
+}
+
+#define PROFILE_FIELD_PACK(name, bits) \
+    e->name = c->name > PROFILE_FIELD_MAX(bits) ? PROFILE_FIELD_MAX(bits) : c->name;
+#define PROFILE_FIELD_UNPACK(name, bits) \
+    c->name = e->name;
+
+void profile_pack()
+{
+    for (unsigned i = 0; i < NUM_EVENTS; ++i) {
+        event_t *e = &profile.events[i];
+        const event_counters_t *c = &profile_counters[i];
+        PROFILE_EVENT_FIELDS(PROFILE_FIELD_PACK)
+    }
 }
 
+void profile_unpack()
+{
+    for (unsigned i = 0; i < NUM_EVENTS; ++i) {
+        const event_t *e = &profile.events[i];
+        event_counters_t *c = &profile_counters[i];
+        PROFILE_EVENT_FIELDS(PROFILE_FIELD_UNPACK)
+    }
+}
+
+#ifdef CONFIG_PROFILE_APPROX_COUNTS
+// Morris counter: returns 1 with probability 2^-c, the increment for value c
+static inline unsigned morris_step(unsigned c)
+{
+    for (; c >= 16; c -= 16)
+        if (random_fast() != 0xFFFF) // output is never zero
+            return 0;
+    return !(random_fast() & ((1 << c) - 1));
+}
+#define COUNTER_STEP(c) morris_step(c)
+#else // !CONFIG_PROFILE_APPROX_COUNTS
+#define COUNTER_STEP(c) 1
+#endif // !CONFIG_PROFILE_APPROX_COUNTS
+
+#ifdef CONFIG_PROFILE_TRANSITIONS
 // Returns true if overflowed
 static inline bool inc_with_overflow(uint8_t *addr, uint8_t max)
 {
     if (*addr == max)
         return true;
-    *addr = *addr + 1;
+    *addr += COUNTER_STEP(*addr);
     return false;
 }
+#endif // CONFIG_PROFILE_TRANSITIONS
 
 bool profile_event(unsigned index, uint16_t vcap)
 {
-    uint8_t cnt;
-
-    cnt = profile.events[index].count;
-    if (inc_with_overflow(&cnt, PROFILE_COUNT_MASK))
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+    uint16_t sample = vcap << EHIST_EDGE_FRAC_BITS;
+    if (sample > ehist_edge_est) {
+        ehist_edge_est = ehist_edge_est < EHIST_EDGE_MAX - PROFILING_EHIST_EDGE_STEP ?
+                            ehist_edge_est + PROFILING_EHIST_EDGE_STEP : EHIST_EDGE_MAX;
+    } else if (sample < ehist_edge_est) {
+        ehist_edge_est = ehist_edge_est > PROFILING_EHIST_EDGE_STEP ?
+                            ehist_edge_est - PROFILING_EHIST_EDGE_STEP : 0;
+    }
+#endif // CONFIG_PROFILE_ADAPTIVE_BINS
+
+    event_counters_t *c = &profile_counters[index];
+#ifdef CONFIG_PROFILE_COMP_BINS
+    unsigned bin = vbank_tap >= PROFILING_COMP_BIN_EDGE_TAP; // Vbank above the edge tap
+#else // !CONFIG_PROFILE_COMP_BINS
+    unsigned bin = vcap > EHIST_BIN_EDGE;
+#endif // !CONFIG_PROFILE_COMP_BINS
+    uint16_t *bin_counter = &c->ehist_bin0 + bin;
+
+    c->count += COUNTER_STEP(c->count);
+    *bin_counter += COUNTER_STEP(*bin_counter);
+    if ((c->count & PROFILE_FIELD_OVERFLOW(PROFILE_COUNT_BITS)) |
+        (*bin_counter & PROFILE_FIELD_OVERFLOW(PROFILE_EHIST_BIN_BITS)))
         goto overflow;
-    profile.events[index].count = cnt;
 
-    if (vcap > PROFILING_EHIST_BIN_EDGE_0) {
-        cnt = profile.events[index].ehist_bin1;
-        if (inc_with_overflow(&cnt, PROFILE_EHIST_BIN_MASK))
-            goto overflow;
-        profile.events[index].ehist_bin1 = cnt;
+#ifdef CONFIG_PROFILE_TRANSITIONS
+    if (last_event != PROFILE_NO_EVENT) {
+        unsigned t = last_event * NUM_EVENTS + index;
+        uint8_t *pair = &profile_transitions.counts[t >> 1];
+        unsigned shift = (t & 0x1) << 2;
+        uint8_t cnt = (*pair >> shift) & PROFILE_TRANSITION_COUNT_MASK;
+        if (!inc_with_overflow(&cnt, PROFILE_TRANSITION_COUNT_MASK)) // saturate, don't stop
+            *pair = (*pair & ~(PROFILE_TRANSITION_COUNT_MASK << shift)) | (cnt << shift);
     } else {
-        cnt = profile.events[index].ehist_bin0;
-        if (inc_with_overflow(&cnt, PROFILE_EHIST_BIN_MASK))
-            goto overflow;
-        profile.events[index].ehist_bin0 = cnt;
+        profile_transitions.first = index;
     }
+    last_event = index;
+#endif // CONFIG_PROFILE_TRANSITIONS
 
     return false; // don't wakeup the MCU
 
 overflow:
     // Disable watchpoints to avoid counting any other watchpoints, as soon as possible
     toggle_watchpoints(false);
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+    stop_duty_cycle();
+#endif // CONFIG_PROFILE_DUTY_CYCLE
 
     profiling_overflow = true;
     return true; // wake up the MCU
@@ -165,6 +553,12 @@ void COMP_VBANK_ISR (void)
         case COMP_VBANK(IV_IIFG):
             break;
         case COMP_VBANK(IV_IFG):
+#ifdef VBANK_TAP_TRACKING
+            if (track_vbank_tap()) {
+                COMP_VBANK(INT) &= ~COMP_VBANK(IFG); // in case the output settled late
+                return; // keep profiling, MCU stays asleep
+            }
+#endif // VBANK_TAP_TRACKING
             COMP_VBANK(INT) &= ~COMP_VBANK(IE);
             COMP_VBANK(CTL1) &= ~COMP_VBANK(ON);
             profiling_vcap_ok = false; // tell main to stop profiling
@@ -172,3 +566,17 @@ void COMP_VBANK_ISR (void)
     }
     __bic_SR_register_on_exit(LPM4_bits); // Exit active CPU
 }
+
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+__attribute__ ((interrupt(TIMER0_B1_VECTOR)))
+void TIMER0_B1_ISR (void)
+{
+    switch (__even_in_range(TB0IV, TB0IV_TBIFG)) {
+        case TB0IV_TBCCR1:
+            on_duty_window_edge();
+            break;
+        default:
+            break;
+    }
+}
+#endif // CONFIG_PROFILE_DUTY_CYCLE
@@ -5,13 +5,24 @@
 #include <stdbool.h>
 
 #define NUM_EVENTS             4    // num watchpoints
-#define PROFILE_EHIST_BIN_MASK 0x1F // must match the bitfield length in event_t
-#define PROFILE_COUNT_MASK     0xFC // must match the bitfield length in event_t
+#define PROFILE_EHIST_BIN_BITS 5
+#define PROFILE_COUNT_BITS     6
 
+#define PROFILE_FIELD_MAX(bits) ((1 << (bits)) - 1)
+#define PROFILE_EHIST_BIN_MASK PROFILE_FIELD_MAX(PROFILE_EHIST_BIN_BITS)
+#define PROFILE_COUNT_MASK     PROFILE_FIELD_MAX(PROFILE_COUNT_BITS)
+
+// Fields of event_t, in the order of the pkt: X(name, bits). The wire format,
+// the counters used during the run (see profile.c), and the code that packs
+// one into the other are generated from this list. The bins must be adjacent.
+#define PROFILE_EVENT_FIELDS(X) \
+    X(ehist_bin0, PROFILE_EHIST_BIN_BITS) \
+    X(ehist_bin1, PROFILE_EHIST_BIN_BITS) \
+    X(count,      PROFILE_COUNT_BITS)
+
+#define PROFILE_FIELD_BITFIELD(name, bits) uint8_t name:bits;
 typedef struct __attribute__((packed)) {
-    uint8_t ehist_bin0:5;
-    uint8_t ehist_bin1:5;
-    uint8_t count:6;
+    PROFILE_EVENT_FIELDS(PROFILE_FIELD_BITFIELD)
 } event_t;
 
 typedef struct __attribute__((packed)) {
@@ -21,9 +32,58 @@ typedef struct __attribute__((packed)) {
 
 extern profile_t profile;
 
+#ifdef CONFIG_PROFILE_TRANSITIONS
+#define PROFILE_TRANSITION_COUNT_MASK 0xF // counters saturate
+#define PROFILE_NO_EVENT NUM_EVENTS
+
+// Counts of consecutive watchpoint pairs, as 4-bit counters: the counter
+// of transition i -> j is nibble (i * NUM_EVENTS + j), low nibble first.
+// Not checkpointed: a run recovered from a checkpoint has no transitions.
+typedef struct __attribute__((packed)) {
+    uint8_t first; // watchpoint hit first in the run, or PROFILE_NO_EVENT
+    uint8_t counts[NUM_EVENTS * NUM_EVENTS / 2];
+} profile_transitions_t;
+
+extern profile_transitions_t profile_transitions;
+#endif // CONFIG_PROFILE_TRANSITIONS
+
+#ifdef CONFIG_PROFILE_ADAPTIVE_BINS
+// Bin edge used for the profile (see EHIST_EDGE_TO_BYTE in ehist.h)
+extern uint8_t profile_ehist_edge;
+
+// Set the bin edge to the one saved by the last completed run
+void restore_ehist_edge();
+// Persist the estimate updated by this run, for the next run
+void save_ehist_edge();
+#endif // CONFIG_PROFILE_ADAPTIVE_BINS
+
+#ifdef CONFIG_PROFILE_DUTY_CYCLE
+// Fraction of the run with watchpoints enabled, in 1/256: the profile counts
+// events in that fraction only. Nominal value for a run recovered from a
+// checkpoint.
+#define PROFILE_DUTY_CYCLE_NOMINAL (256UL * PROFILING_DUTY_WINDOW / PROFILING_DUTY_PERIOD)
+extern uint8_t profile_duty_cycle;
+#endif // CONFIG_PROFILE_DUTY_CYCLE
+
+// Why the last profiling run stopped
+typedef enum {
+    PROFILE_STOP_UNKNOWN    = 0, // e.g. run recovered from a checkpoint
+    PROFILE_STOP_VCAP       = 1, // Vbank dropped below threshold
+    PROFILE_STOP_OVERFLOW   = 2, // a counter saturated, counting stopped early
+    PROFILE_STOP_TIMEOUT    = 3,
+    // NOTE: field size is 2 bits
+} profile_stop_t;
+
 void start_profiling();
 bool continue_profiling();
 void stop_profiling();
+profile_stop_t profile_stop_reason();
+
+// The callback counts in word-sized counters, which are copied into
+// 'profile' (saturated) at checkpoints and at the end of the run
+void profile_pack();
+// Load the counters from 'profile'
+void profile_unpack();
 
 // Process the event, and returns whether to wake up the MCU or not afterwards
 bool profile_event(unsigned index, uint16_t vcap);
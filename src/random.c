@@ -5,6 +5,10 @@
 
 #include <libio/console.h>
 
+#include "random.h"
+
+uint16_t random_fast_state = 1; // must not be zero
+
 // Seed random generator by reading an analog voltage from ADC (Vbank)
 void seed_random_from_adc()
 {
@@ -32,3 +36,13 @@ void seed_random_from_adc()
     LOG("rnd seed=%u\r\n", seed);
     srand(seed);
 }
+
+void seed_random(uint16_t sample)
+{
+    srand(sample);
+}
+
+void seed_random_fast()
+{
+    random_fast_state = rand() | 0x1;
+}
@@ -1,6 +1,27 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
+#include <stdint.h>
+
 void seed_random_from_adc();
 
+// Seed from a sample taken by the caller, to reuse its ADC setup
+void seed_random(uint16_t sample);
+
+// Cheap generator for use in ISRs (xorshift, period 2^16 - 1)
+extern uint16_t random_fast_state;
+
+// Seed from rand(), so once seed_random_from_adc() was called, if at all
+void seed_random_fast();
+
+static inline uint16_t random_fast()
+{
+    uint16_t x = random_fast_state;
+    x ^= x << 7;
+    x ^= x >> 9;
+    x ^= x << 8;
+    random_fast_state = x;
+    return x;
+}
+
 #endif // RANDOM_H